@@ -47,6 +47,7 @@ set debugMode=1
 set asanEnabled=0
 set includeZlib=0
 set name=strip_comments
+set benchName=strip_bench
 set outputDir=final
 set buildDir=build
 set linker=
@@ -103,6 +104,9 @@ echo --------------------
 cl -nologo %flags% %warnings% %defines% -Fe%outputDir%/%name%.exe -Fo%buildDir%/ src/main.cpp %includes% %links% -INCREMENTAL:NO %linker%
 if not !ERRORLEVEL! == 0 ( goto build_failed )
 
+cl -nologo %flags% %warnings% %defines% -Fe%outputDir%/%benchName%.exe -Fo%buildDir%/ src/bench.cpp %includes% %links% -INCREMENTAL:NO %linker%
+if not !ERRORLEVEL! == 0 ( goto build_failed )
+
 :build_success
 echo Build success!
 goto build_end
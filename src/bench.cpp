@@ -0,0 +1,364 @@
+
+#include "core.h"
+#include "corpus_functions.h"
+
+enum ERROR_CODE
+{
+	ERROR_CODE_FAILED_TO_INITIALISE_MEMORY_ARENA = -2,
+	ERROR_CODE_FAILED_TO_INITIALISE_PLATFORM = -3,
+	ERROR_CODE_INVALID_ARGUMENTS = -4,
+	ERROR_CODE_FAILED_TO_WRITE_CORPUS = -5,
+	ERROR_CODE_ENGINE_MISMATCH = -6,
+};
+
+// -------------------------------------------------------
+// CORPUS
+// -------------------------------------------------------
+
+// Many small files of ordinary source, then one set for each of the cases that are hard on a
+// stripper. Scaling changes how many files a set has, or how big its one file is
+struct BenchSet
+{
+	CorpusKind kind;
+	u64 fileCount;
+	u64 fileSize;			// the mean for source files, the others are all this size
+};
+
+struct BenchCorpus
+{
+	CorpusKind kind;
+	u8 **files;
+	u64 *sizes;
+	u64 fileCount;
+	u64 bytes;
+	u64 largest;
+};
+
+static bool bench_generate( BenchCorpus *corpus, const BenchSet *set, const CorpusOptions *options, u64 seed, f32 scale, Allocator *allocator )
+{
+	u64 fileCount = set->fileCount;
+	u64 fileSize = set->fileSize;
+
+	if ( fileCount > 1 )
+		fileCount = max<u64>( static_cast<u64>( fileCount * scale ), 1 );
+	else
+		fileSize = max<u64>( static_cast<u64>( fileSize * scale ), 1 );
+
+	corpus->kind = set->kind;
+	corpus->fileCount = fileCount;
+	corpus->bytes = 0;
+	corpus->largest = 0;
+	corpus->files = allocator->allocate<u8 *>( fileCount );
+	corpus->sizes = allocator->allocate<u64>( fileCount );
+
+	if ( !corpus->files || !corpus->sizes )
+		return false;
+
+	// Each set has its own stream, so changing one set's options doesn't change the others
+	Xoshiro256starstar random;
+	corpus_seed( &random, seed + set->kind );
+
+	for ( u64 i = 0; i < fileCount; ++i )
+	{
+		// Source files vary from a quarter to one and three quarters of the mean
+		u64 size = ( set->kind == CORPUS_KIND_SOURCE ? fileSize / 4 + random.next() % ( fileSize * 3 / 2 + 1 ) : fileSize );
+
+		corpus->files[ i ] = allocator->allocate<u8>( size + 1, false, 64 );
+
+		if ( !corpus->files[ i ] )
+			return false;
+
+		corpus_generate( set->kind, options, &random, corpus->files[ i ], size );
+
+		corpus->sizes[ i ] = size;
+		corpus->bytes += size;
+		corpus->largest = max( corpus->largest, size );
+	}
+
+	return true;
+}
+
+static bool bench_write( const BenchCorpus *corpus, const char *directory )
+{
+	char path[ MAX_FILEPATH ];
+
+	for ( u64 i = 0; i < corpus->fileCount; ++i )
+	{
+		snprintf( path, sizeof( path ), "%s/%s-%05" PRIu64 ".c", directory, CORPUS_KIND_NAMES[ corpus->kind ], i );
+
+		if ( write_file( path, corpus->files[ i ], corpus->sizes[ i ], false ) != corpus->sizes[ i ] )
+			return false;
+	}
+
+	return true;
+}
+
+// -------------------------------------------------------
+// TIMING
+// -------------------------------------------------------
+
+struct BenchResult
+{
+	u64 ticks;				// the fastest of the repeats
+	u64 hash;				// of every output, so each engine can be checked against the scalar one
+};
+
+static BenchResult bench_engine( StripEngine engine, const BenchCorpus *corpus, u32 repeats, u8 *dst )
+{
+	BenchResult result = { UINT64_MAX, 0 };
+	u64 written = 0;
+
+	for ( u32 repeat = 0; repeat < repeats; ++repeat )
+	{
+		u64 start = platform_get_tick_counter();
+
+		for ( u64 i = 0; i < corpus->fileCount; ++i )
+			written += strip_comments( engine, corpus->files[ i ], corpus->sizes[ i ], dst );
+
+		result.ticks = min( result.ticks, platform_get_tick_counter() - start );
+	}
+
+	// Checked outside the timing
+	ManifestHash hash;
+	manifest_hash_begin( &hash );
+
+	for ( u64 i = 0; i < corpus->fileCount; ++i )
+	{
+		u64 size = strip_comments( engine, corpus->files[ i ], corpus->sizes[ i ], dst );
+
+		manifest_hash_update( &hash, &size, sizeof( size ) );
+		manifest_hash_update( &hash, dst, size );
+	}
+
+	// The outputs are used, so none of the timed calls can be dropped
+	result.hash = manifest_hash_end( &hash ) + ( written == UINT64_MAX ? 1 : 0 );
+
+	return result;
+}
+
+// -------------------------------------------------------
+// ENTRY
+// -------------------------------------------------------
+
+static bool bench_parse_f32( const char *arg, f32 *value )
+{
+	char *end;
+	*value = strtof( arg, &end );
+
+	return end != arg && *end == '\0' && *value >= 0.f;
+}
+
+static bool bench_parse_u64( const char *arg, u64 *value )
+{
+	const char *end;
+	*value = convert_to_u64( arg, &end );
+
+	return end != arg && *end == '\0';
+}
+
+int main( int argc, char *argv[] )
+{
+	{
+		MemoryArena memoryArena = memory_default();
+
+		// The big sets need far more than a normal run, but it is all reserved and committed as used
+		if ( !memoryArena.init_virtual( MB( 16 ), GB( 64ull ), MB( 64 ), MB( 64 ) ) )
+		{
+			fprintf( stderr, "Failed to initialise memory arena.\n" );
+			return ERROR_CODE_FAILED_TO_INITIALISE_MEMORY_ARENA;
+		}
+
+		if ( !platform_init( &memoryArena ) )
+		{
+			fprintf( stderr, "Failed to initialise platform.\n" );
+			return ERROR_CODE_FAILED_TO_INITIALISE_PLATFORM;
+		}
+	}
+
+	// -- arguments ---------------------------------------------
+	CorpusOptions options = corpus_default_options();
+	StripEngine onlyEngine = STRIP_ENGINE_COUNT;
+	const char *writeDirectory = nullptr;
+	u64 seed = 1;
+	u64 repeats = 5;
+	f32 scale = 1.f;
+
+	BenchSet sets[ CORPUS_KIND_COUNT ] =
+	{
+		{ CORPUS_KIND_SOURCE, 2000, KB( 8 ) },
+		{ CORPUS_KIND_BLOCK_COMMENT, 1, MB( 50 ) },
+		{ CORPUS_KIND_SHORT_LINES, 1, MB( 8 ) },			// four million lines
+		{ CORPUS_KIND_ESCAPES, 16, MB( 1 ) },
+	};
+
+	for ( i32 argEntry = 1; argEntry < argc; ++argEntry )
+	{
+		const char *arg = argv[ argEntry ];
+		const char *value = ( argEntry + 1 < argc ? argv[ argEntry + 1 ] : nullptr );
+		bool valid = ( value != nullptr );
+		u64 number = 0;
+
+		if ( string_utf8_compare( arg, "--seed" ) )
+			valid = valid && bench_parse_u64( value, &seed );
+		else if ( string_utf8_compare( arg, "--repeat" ) )
+			valid = valid && bench_parse_u64( value, &repeats ) && repeats > 0;
+		else if ( string_utf8_compare( arg, "--scale" ) )
+			valid = valid && bench_parse_f32( value, &scale ) && scale > 0.f;
+		else if ( string_utf8_compare( arg, "--files" ) )
+			valid = valid && bench_parse_u64( value, &sets[ CORPUS_KIND_SOURCE ].fileCount );
+		else if ( string_utf8_compare( arg, "--size" ) )
+			valid = valid && bench_parse_u64( value, &sets[ CORPUS_KIND_SOURCE ].fileSize );
+		else if ( string_utf8_compare( arg, "--comments" ) )
+			valid = valid && bench_parse_f32( value, &options.commentDensity );
+		else if ( string_utf8_compare( arg, "--block-comments" ) )
+			valid = valid && bench_parse_f32( value, &options.blockCommentShare );
+		else if ( string_utf8_compare( arg, "--strings" ) )
+			valid = valid && bench_parse_f32( value, &options.stringDensity );
+		else if ( string_utf8_compare( arg, "--escapes" ) )
+			valid = valid && bench_parse_f32( value, &options.escapeDensity );
+		else if ( string_utf8_compare( arg, "--line" ) )
+			valid = valid && bench_parse_u64( value, &number ) && number > 0 && ( options.lineLengthMean = static_cast<u32>( number ), true );
+		else if ( string_utf8_compare( arg, "--line-max" ) )
+			valid = valid && bench_parse_u64( value, &number ) && number > 0 && ( options.lineLengthMax = static_cast<u32>( number ), true );
+		else if ( string_utf8_compare( arg, "--engine" ) )
+			valid = valid && ( onlyEngine = strip_engine_from_name( value ) ) != STRIP_ENGINE_COUNT;
+		else if ( string_utf8_compare( arg, "--write" ) )
+			writeDirectory = value;
+		else
+		{
+			fprintf( stderr, "Unknown argument: %s\n", arg );
+			return ERROR_CODE_INVALID_ARGUMENTS;
+		}
+
+		if ( !valid )
+		{
+			fprintf( stderr, "Missing or invalid value after %s\n", arg );
+			return ERROR_CODE_INVALID_ARGUMENTS;
+		}
+
+		argEntry += 1;
+	}
+
+	// -- corpus ---------------------------------------------
+	Allocator *allocator = &memory->transient;
+	BenchCorpus corpora[ CORPUS_KIND_COUNT ];
+	u64 largest = 0;
+
+	for ( u32 i = 0; i < CORPUS_KIND_COUNT; ++i )
+	{
+		if ( !bench_generate( &corpora[ i ], &sets[ i ], &options, seed, scale, allocator ) )
+		{
+			fprintf( stderr, "Failed to allocate memory for the %s corpus.\n", CORPUS_KIND_NAMES[ i ] );
+			return ERROR_CODE_FAILED_TO_INITIALISE_MEMORY_ARENA;
+		}
+
+		largest = max( largest, corpora[ i ].largest );
+	}
+
+	// Written out for the tool to be run on, into a directory that already exists. Nothing is timed
+	if ( writeDirectory )
+	{
+		for ( const BenchCorpus &corpus : corpora )
+		{
+			if ( !bench_write( &corpus, writeDirectory ) )
+			{
+				fprintf( stderr, "Failed to write the %s corpus to %s\n", CORPUS_KIND_NAMES[ corpus.kind ], writeDirectory );
+				return ERROR_CODE_FAILED_TO_WRITE_CORPUS;
+			}
+
+			printf( "%s/%s-*.c: %" PRIu64 " files, %" PRIu64 " bytes\n", writeDirectory, CORPUS_KIND_NAMES[ corpus.kind ], corpus.fileCount, corpus.bytes );
+		}
+
+		return 0;
+	}
+
+	// Engines may write a block past the output
+	u8 *dst = allocator->allocate<u8>( largest + KB( 1 ), false, 64 );
+
+	if ( !dst )
+	{
+		fprintf( stderr, "Failed to allocate memory ( %" PRIu64 " bytes )\n", largest + KB( 1 ) );
+		return ERROR_CODE_FAILED_TO_INITIALISE_MEMORY_ARENA;
+	}
+
+	// -- timing ---------------------------------------------
+	f64 frequency = static_cast<f64>( platform_get_tick_frequency() );
+	int result = 0;
+
+	// Cycles are time stamp counter ticks, which run at a fixed rate whatever the core clock is doing
+	printf( "seed %" PRIu64 ", scale %g, best of %" PRIu64 ", %.2f GHz time stamp counter\n\n", seed, scale, repeats, frequency / 1e9 );
+	printf( "%-14s %-7s %8s %10s %10s %12s %14s\n", "corpus", "engine", "files", "MB", "MB/s", "bytes/cycle", "cycles/file" );
+
+	for ( const BenchCorpus &corpus : corpora )
+	{
+		u64 reference = 0;
+
+		for ( StripEngine engine = 0; engine < STRIP_ENGINE_COUNT; ++engine )
+		{
+			// The scalar engine is always run, it is what the others are checked against
+			if ( onlyEngine != STRIP_ENGINE_COUNT && engine != onlyEngine && engine != STRIP_ENGINE_SCALAR )
+				continue;
+
+			if ( engine == STRIP_ENGINE_AVX2 && !platform_cpu_supports_avx2() )
+				continue;
+
+			BenchResult bench = bench_engine( engine, &corpus, static_cast<u32>( repeats ), dst );
+			f64 ticks = static_cast<f64>( max<u64>( bench.ticks, 1 ) );
+			f64 mb = static_cast<f64>( corpus.bytes ) / static_cast<f64>( MB( 1 ) );
+
+			if ( engine == STRIP_ENGINE_SCALAR )
+				reference = bench.hash;
+
+			printf( "%-14s %-7s %8" PRIu64 " %10.2f %10.1f %12.3f %14.0f%s\n",
+				CORPUS_KIND_NAMES[ corpus.kind ], STRIP_ENGINE_NAMES[ engine ], corpus.fileCount, mb,
+				mb / ( ticks / frequency ), static_cast<f64>( corpus.bytes ) / ticks, ticks / static_cast<f64>( corpus.fileCount ),
+				bench.hash != reference ? "  MISMATCH" : "" );
+
+			if ( bench.hash != reference )
+				result = ERROR_CODE_ENGINE_MISMATCH;
+		}
+	}
+
+	return result;
+}
+
+// -- UNITY BUILD --
+#if defined( __PLATFORM_WINDOWS__ )
+#include "platform_windows.cpp"
+#elif defined( __PLATFORM_LINUX__ )
+#include "platform_linux.cpp"
+#else
+#warning No Platform Selected.
+#endif
+
+#include "utility.cpp"
+
+#define FILE_FUNCTIONS_IMPLEMENTATION
+#include "file_functions.h"
+
+#define MATH_FUNCTIONS_IMPLEMENTATION
+#include "math_functions.h"
+
+#define RANDOM_FUNCTIONS_IMPLEMENTATION
+#include "random_functions.h"
+
+#define STRING_FUNCTIONS_IMPLEMENTATION
+#include "string_functions.h"
+
+#define MEMORY_FUNCTIONS_IMPLEMENTATION
+#include "memory_functions.h"
+
+#define STRIP_FUNCTIONS_IMPLEMENTATION
+#include "strip_functions.h"
+
+#define THREAD_FUNCTIONS_IMPLEMENTATION
+#include "thread_functions.h"
+
+#define TRACE_FUNCTIONS_IMPLEMENTATION
+#include "trace_functions.h"
+
+#define MANIFEST_FUNCTIONS_IMPLEMENTATION
+#include "manifest_functions.h"
+
+#define CORPUS_FUNCTIONS_IMPLEMENTATION
+#include "corpus_functions.h"
@@ -4,12 +4,19 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <inttypes.h>
 #include <stdarg.h>
 #include <string.h>
 #include <math.h>
 #include <float.h>
 #include <time.h>
+#if defined( _MSC_VER )
 #include <intrin.h>
+#else
+#include <x86intrin.h>
+#include <unistd.h>
+#define __debugbreak() __builtin_trap()
+#endif
 
 using i8  = int8_t;
 using i16 = int16_t;
@@ -38,29 +45,34 @@ void message_log( const char *message, ... );
 void message_warning( const char *file, i32 line, const char *message, ... );
 void message_error( const char *file, i32 line, const char *message, ... );
 
+// Where log and log_warning print, stdout unless that is carrying output
+FILE *messageFile = nullptr;
+
 void handle_assert( const char *file, i32 line, const char *condition )
 {
 	fprintf( stderr, "FAILED ASSERT: %s\n%s (%i)\n", condition, file, line );
 	__debugbreak();
 }
 
+// Messages are formatted first and printed with one call, so lines from different threads don't mix
 void message_log( const char *message, ... )
 {
+	char buffer[ 1024 ];
 	va_list args;
 	va_start( args, message );
-	vprintf( message, args );
+	vsnprintf( buffer, sizeof( buffer ), message, args );
 	va_end( args );
-	printf( "\n" );
+	fprintf( messageFile ? messageFile : stdout, "%s\n", buffer );
 }
 
 void message_warning( const char *file, i32 line, const char *message, ... )
 {
-	printf( "[WARN]: @ %s (%d)\n\t", file, line );
+	char buffer[ 1024 ];
 	va_list args;
 	va_start( args, message );
-	vprintf( message, args );
+	vsnprintf( buffer, sizeof( buffer ), message, args );
 	va_end( args );
-	printf( "\n" );
+	fprintf( messageFile ? messageFile : stdout, "[WARN]: @ %s (%d)\n\t%s\n", file, line, buffer );
 }
 
 void message_error( const char *file, i32 line, const char *message, ... )
@@ -102,8 +114,9 @@ void message_error( const char *file, i32 line, const char *message, ... )
 
 constexpr u64 MAX_FILEPATH = 260;
 
+// The platform is shared, each thread points memory at its own arena
 struct Platform *platform = nullptr;
-struct MemoryArena *memory = nullptr;
+thread_local struct MemoryArena *memory = nullptr;
 
 #ifdef INCLUDE_ZLIB
 #include "zlib.h"
@@ -118,4 +131,8 @@ struct MemoryArena *memory = nullptr;
 #include "map.h"
 #include "utility.h"
 #include "platform.h"
-#include "file_functions.h"
\ No newline at end of file
+#include "file_functions.h"
+#include "strip_functions.h"
+#include "thread_functions.h"
+#include "trace_functions.h"
+#include "manifest_functions.h"
\ No newline at end of file
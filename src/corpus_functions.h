@@ -0,0 +1,313 @@
+
+#ifndef _HG_CORPUS_FUNCTIONS
+#define _HG_CORPUS_FUNCTIONS
+
+// Synthetic C-like source for benchmarking. The same seed and options always give the same bytes,
+// so runs on different builds and machines strip exactly the same input
+
+using CorpusKind = u8;
+enum CORPUS_KIND : CorpusKind
+{
+	CORPUS_KIND_SOURCE,					// code with comments and literals as often as the options say
+	CORPUS_KIND_BLOCK_COMMENT,			// the whole file is a single block comment
+	CORPUS_KIND_SHORT_LINES,			// one character lines, so every other byte is a newline
+	CORPUS_KIND_ESCAPES,				// string and character literals that are mostly escapes
+	CORPUS_KIND_COUNT,
+};
+
+constexpr const char *CORPUS_KIND_NAMES[ CORPUS_KIND_COUNT ] =
+{
+	"source",
+	"block-comment",
+	"short-lines",
+	"escapes",
+};
+
+struct CorpusOptions
+{
+	f32 commentDensity;				// chance a line has a comment, 0 to 1
+	f32 blockCommentShare;			// chance a comment is a block comment rather than a line comment
+	f32 stringDensity;				// chance a line has a string or character literal
+	f32 escapeDensity;				// chance each character of a literal is an escape
+	u32 lineLengthMean;				// line lengths are exponentially distributed around this
+	u32 lineLengthMax;
+};
+
+[[nodiscard]] CorpusOptions corpus_default_options();
+
+// Seeded through splitmix64, like the platform's generators
+void corpus_seed( Xoshiro256starstar *random, u64 seed );
+
+// Fills exactly size bytes and puts a null terminator at buffer[ size ]
+void corpus_generate( CorpusKind kind, const CorpusOptions *options, Xoshiro256starstar *random, u8 *buffer, u64 size );
+
+#endif // _HG_CORPUS_FUNCTIONS
+
+// --------------------------------------------------------------------------------
+
+#if defined( CORPUS_FUNCTIONS_IMPLEMENTATION )
+
+struct CorpusWriter
+{
+	Xoshiro256starstar *random;
+	u8 *data;
+	u64 size;
+	u64 used;
+};
+
+[[nodiscard]] static inline u64 corpus_random( CorpusWriter *writer, u64 count )
+{
+	return writer->random->next() % count;
+}
+
+[[nodiscard]] static inline bool corpus_chance( CorpusWriter *writer, f32 chance )
+{
+	return static_cast<f64>( writer->random->next() >> 11 ) * 0x1.0p-53 < chance;
+}
+
+// Anything past the end is dropped, generators take back a line that didn't fit
+static inline void corpus_put( CorpusWriter *writer, u8 c )
+{
+	if ( writer->used < writer->size )
+		writer->data[ writer->used++ ] = c;
+}
+
+static void corpus_put( CorpusWriter *writer, const char *text )
+{
+	while ( *text )
+		corpus_put( writer, static_cast<u8>( *text++ ) );
+}
+
+static void corpus_put_from( CorpusWriter *writer, const char *set )
+{
+	corpus_put( writer, static_cast<u8>( set[ corpus_random( writer, strlen( set ) ) ] ) );
+}
+
+static u32 corpus_line_length( CorpusWriter *writer, const CorpusOptions *options )
+{
+	// Never 0, so the log is always finite
+	f32 u = static_cast<f32>( ( writer->random->next() >> 40 ) + 1 ) * 0x1.0p-24f;
+	f32 length = -logf( u ) * static_cast<f32>( options->lineLengthMean );
+
+	return static_cast<u32>( min( length, static_cast<f32>( options->lineLengthMax ) ) );
+}
+
+constexpr const char *CORPUS_IDENTIFIER = "abcdefghijklmnopqrstuvwxyz_ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+constexpr const char *CORPUS_TEXT = "abcdefghijklmnopqrstuvwxyz      .,";
+constexpr const char *CORPUS_ESCAPES[] = { "\\n", "\\t", "\\\\", "\\\"", "\\'", "\\x41", "\\101", "\\0", "\\\n" };
+
+// Words with the odd stray slash or star, the bytes that make a stripper look twice. Never a
+// star then a slash though, the text goes in comments and that would end them early
+static void corpus_put_text( CorpusWriter *writer, u32 length )
+{
+	for ( u32 i = 0; i < length; ++i )
+	{
+		const char *set = ( corpus_random( writer, 64 ) == 0 ? "/*" : CORPUS_TEXT );
+		u8 c = static_cast<u8>( set[ corpus_random( writer, strlen( set ) ) ] );
+
+		if ( c == '/' && writer->used > 0 && writer->used <= writer->size && writer->data[ writer->used - 1 ] == '*' )
+			c = ' ';
+
+		corpus_put( writer, c );
+	}
+}
+
+// Comment markers inside a literal aren't comments, so they turn up there now and then
+static void corpus_put_literal( CorpusWriter *writer, const CorpusOptions *options, char quote, u32 length )
+{
+	corpus_put( writer, static_cast<u8>( quote ) );
+
+	for ( u32 i = 0; i < length; ++i )
+	{
+		if ( corpus_chance( writer, options->escapeDensity ) )
+			corpus_put( writer, CORPUS_ESCAPES[ corpus_random( writer, sizeof( CORPUS_ESCAPES ) / sizeof( CORPUS_ESCAPES[ 0 ] ) ) ] );
+		else if ( corpus_random( writer, 32 ) == 0 )
+			corpus_put( writer, corpus_random( writer, 2 ) ? "//" : "/*" );
+		else
+			corpus_put_from( writer, CORPUS_TEXT );
+	}
+
+	corpus_put( writer, static_cast<u8>( quote ) );
+}
+
+static void corpus_put_comment( CorpusWriter *writer, const CorpusOptions *options, u32 length )
+{
+	if ( !corpus_chance( writer, options->blockCommentShare ) )
+	{
+		corpus_put( writer, "// " );
+		corpus_put_text( writer, length );
+		return;
+	}
+
+	corpus_put( writer, "/* " );
+
+	// Some of them run over a few lines
+	u32 lines = ( corpus_random( writer, 4 ) == 0 ? static_cast<u32>( corpus_random( writer, 6 ) ) : 0 );
+
+	for ( u32 i = 0; i < lines; ++i )
+	{
+		corpus_put_text( writer, corpus_line_length( writer, options ) );
+		corpus_put( writer, "\n * " );
+	}
+
+	corpus_put_text( writer, length );
+	corpus_put( writer, " */" );
+}
+
+static void corpus_put_code( CorpusWriter *writer, u32 length )
+{
+	u64 start = writer->used;
+
+	while ( writer->used - start < length && writer->used < writer->size )
+	{
+		switch ( corpus_random( writer, 8 ) )
+		{
+			case 0:
+			case 1:
+			case 2:
+			{
+				u32 identifier = 1 + static_cast<u32>( corpus_random( writer, 12 ) );
+				for ( u32 i = 0; i < identifier; ++i )
+					corpus_put_from( writer, CORPUS_IDENTIFIER );
+				break;
+			}
+
+			case 3:		corpus_put_from( writer, "0123456789" ); break;
+			case 4:		corpus_put( writer, ' ' ); break;
+			case 5:		corpus_put_from( writer, "+-*=<>&|!?:.,~^%" ); break;
+			case 6:		corpus_put_from( writer, "(){}[];" ); break;
+
+			// Division, so not every slash starts a comment
+			default:	corpus_put( writer, " / " ); break;
+		}
+	}
+}
+
+static void corpus_generate_source( CorpusWriter *writer, const CorpusOptions *options )
+{
+	while ( writer->used < writer->size )
+	{
+		u64 start = writer->used;
+
+		u32 indent = static_cast<u32>( corpus_random( writer, 4 ) );
+		for ( u32 i = 0; i < indent; ++i )
+			corpus_put( writer, '\t' );
+
+		u32 length = corpus_line_length( writer, options );
+		corpus_put_code( writer, length / 2 );
+
+		if ( corpus_chance( writer, options->stringDensity ) )
+		{
+			corpus_put( writer, " = " );
+			corpus_put_literal( writer, options, corpus_random( writer, 4 ) ? '"' : '\'', corpus_random( writer, 4 ) ? length / 2 : 1 );
+			corpus_put( writer, ';' );
+		}
+
+		if ( corpus_chance( writer, options->commentDensity ) )
+		{
+			corpus_put( writer, ' ' );
+			corpus_put_comment( writer, options, length / 2 );
+		}
+
+		corpus_put( writer, '\n' );
+
+		// A line cut short could leave a comment or literal open, so it goes and the rest is blank
+		if ( writer->used == writer->size )
+		{
+			writer->used = start;
+			break;
+		}
+	}
+}
+
+static void corpus_generate_block_comment( CorpusWriter *writer )
+{
+	corpus_put( writer, "/*" );
+
+	while ( writer->used + 2 < writer->size )
+	{
+		corpus_put_text( writer, 79 );
+		corpus_put( writer, '\n' );
+	}
+
+	writer->used = min( writer->used, writer->size - min<u64>( writer->size, 2 ) );
+	corpus_put( writer, "*/" );
+}
+
+static void corpus_generate_short_lines( CorpusWriter *writer )
+{
+	while ( writer->used + 2 <= writer->size )
+	{
+		corpus_put_from( writer, "abcxyz;{}()=+-*/" );
+		corpus_put( writer, '\n' );
+	}
+}
+
+static void corpus_generate_escapes( CorpusWriter *writer, const CorpusOptions *options )
+{
+	CorpusOptions escapes = *options;
+	escapes.escapeDensity = 0.9f;
+
+	while ( writer->used < writer->size )
+	{
+		u64 start = writer->used;
+
+		corpus_put( writer, "s = " );
+		corpus_put_literal( writer, &escapes, corpus_random( writer, 4 ) ? '"' : '\'', 1 + corpus_line_length( writer, options ) / 2 );
+		corpus_put( writer, ";\n" );
+
+		if ( writer->used == writer->size )
+		{
+			writer->used = start;
+			break;
+		}
+	}
+}
+
+CorpusOptions corpus_default_options()
+{
+	return
+	{
+		.commentDensity = 0.3f,
+		.blockCommentShare = 0.3f,
+		.stringDensity = 0.2f,
+		.escapeDensity = 0.05f,
+		.lineLengthMean = 40,
+		.lineLengthMax = 200,
+	};
+}
+
+void corpus_seed( Xoshiro256starstar *random, u64 seed )
+{
+	Splitmix64 splitmix64 = { seed };
+
+	for ( u64 &state : random->state )
+		state = splitmix64.next();
+}
+
+void corpus_generate( CorpusKind kind, const CorpusOptions *options, Xoshiro256starstar *random, u8 *buffer, u64 size )
+{
+	CorpusWriter writer =
+	{
+		.random = random,
+		.data = buffer,
+		.size = size,
+		.used = 0,
+	};
+
+	switch ( kind )
+	{
+		case CORPUS_KIND_BLOCK_COMMENT:	corpus_generate_block_comment( &writer ); break;
+		case CORPUS_KIND_SHORT_LINES:	corpus_generate_short_lines( &writer ); break;
+		case CORPUS_KIND_ESCAPES:		corpus_generate_escapes( &writer, options ); break;
+		default:						corpus_generate_source( &writer, options ); break;
+	}
+
+	// Whatever is left is blank lines
+	while ( writer.used < writer.size )
+		writer.data[ writer.used++ ] = '\n';
+
+	buffer[ size ] = '\0';
+}
+
+#endif
@@ -5,6 +5,7 @@
 constexpr const u64 MAX_FIND_FILES = 4096;
 constexpr const u64 INVALID_FILE_INDEX = UINT64_MAX;
 constexpr const u64 INVALID_DIR_INDEX = UINT64_MAX;
+constexpr const u64 MAX_STAGED_FILES = 256;
 
 using FilePermissions = u8;
 enum FILE_PERMISSION : FilePermissions
@@ -72,6 +73,72 @@ struct FileInDir
 	u64 creationDate;
 };
 
+// Laid out like an iovec so a list of them can be passed to writev directly
+struct FileSpan
+{
+	const void *data;
+	u64 size;
+};
+
+// A file that is written where it can't be seen, and moved over its target once it is durable.
+// Only the file being written is open, the rest are just their names
+struct StagedFile
+{
+	u64 fileID;				// 0 once it is closed
+	u64 device;				// file systems are synced once each, whatever the number of files on them
+	bool named;				// has a .TEMP sibling, otherwise it has no name until it is closed
+	char path[ MAX_FILEPATH ];
+};
+
+struct FileStage
+{
+	u64 count;
+	StagedFile files[ MAX_STAGED_FILES ];
+};
+
+// A file in a batch. Only files with data set are read or written, the rest are passed over
+struct RingFile
+{
+	const char *path;
+	u8 *data;				// inside the ring's buffer, a read needs room for size + 1 bytes
+	u64 size;				// from the stat, then the bytes to write
+	u64 timestamp;			// last edit, from the stat and again after a write when asked for
+	i32 error;				// errno of the first step that failed, 0 if none did
+};
+
+// io_uring, where the kernel has it. Every step of a batch is queued, then submitted and waited
+// for with one system call. Files are opened into the ring's own table and closed from there,
+// so a batch never takes up a descriptor
+struct FileRing
+{
+	i32 fd;
+	bool registered;						// the buffer is pinned, so I/O doesn't map it every time
+	u8 *buffer;
+	u64 bufferSize;
+	Allocator *allocator;
+	struct statx *stats;					// one for each file in a batch
+	u32 queued;								// steps waiting for the next submit
+
+	// Shared with the kernel
+	u8 *rings;
+	u64 ringsSize;
+	struct io_uring_sqe *sqes;
+	u64 sqesSize;
+	u32 *sqTail;
+	u32 *sqArray;
+	u32 sqMask;
+	u32 *cqHead;
+	u32 *cqTail;
+	u32 cqMask;
+	struct io_uring_cqe *cqes;
+};
+
+constexpr const u64 FILE_RING_BATCH_SIZE = 256;
+
+// Called for every regular file a walk finds, on whichever worker found it
+using DirectoryWalkFileFunc = void ( * )( const char *path, u32 worker, void *user );
+using DirectoryWalkFilterFunc = bool ( * )( const char *name );
+
 // Utility
 char *handle_file_includes( const char *root, char *code, u64 codeSize, Allocator *allocator );
 
@@ -89,11 +156,14 @@ bool change_directory( const char *directory );
 bool get_files_in_directory( const char *path, Array<FileInDir, MAX_FIND_FILES> *files, bool fullPath, bool recursive, Allocator *allocator );
 const char *abs_path( const char *path, char *abPath, u64 abPathFileSize );
 [[nodiscard]] const char *abs_path( const char *path, Allocator *allocator );
+bool walk_directories( const char *const *roots, u64 rootCount, u32 workerCount, DirectoryWalkFilterFunc filter_func, DirectoryWalkFileFunc file_func, void *user );
 
 // Files
 [[nodiscard]] bool file_exists( const char *path );
+[[nodiscard]] u64 file_size( const char *path );
 [[nodiscard]] u8 *read_file( const char *path, u64 *fileSize, bool addNullTerminator, Allocator *allocator );
 u64 write_file( const char *path, const u8 *buffer, u64 size, bool append );
+u64 write_file_spans( const char *path, const FileSpan *spans, u64 count, bool append );
 bool delete_file( const char *path );
 [[nodiscard]] bool file_permissions( const char *path, FilePermissions permissions );
 bool can_open_file( const char *path, FileOptions options, i32 attempts );
@@ -103,15 +173,44 @@ u64 get_file_size( u64 fileID );
 bool seek_in_file( u64 fileID, FileSeek seek, u64 offset );
 u8 *read_whole_file( u64 fileID, Allocator *allocator, bool addNullTerminator );
 u64 read_from_file( u64 fileID, void *buffer, u64 size );
+u64 read_from_file_partial( u64 fileID, void *buffer, u64 size );
 u64 write_to_file( u64 fileID, const void *buffer, u64 size );
+u64 write_to_file_spans( u64 fileID, const FileSpan *spans, u64 count );
 void file_flush( u64 fileID );
+[[nodiscard]] bool file_error( u64 fileID );
+bool truncate_file( u64 fileID, u64 size );
+[[nodiscard]] u64 get_file_last_edit_timestamp( u64 fileID );
 [[nodiscard]] u64 file_creation_timestamp( const char *path );
 [[nodiscard]] u64 file_last_edit_timestamp( const char *path );
+
+// The standard streams as file ids, they are never closed. They are switched to binary and
+// unbuffered, so big reads and writes go straight through instead of being copied in pieces
+u64 open_standard_input();
+u64 open_standard_output();
+
+// Durable writes. A staged file is written with the usual file functions and closed into the stage
+// once it is, so a stage holds names rather than descriptors. A commit publishes a whole stage at
+// once: the file systems are synced, every file is renamed over its target and they are synced
+// again. A crash leaves each target as it was or replaced, never part written. Opening a file into
+// a full stage commits it first
+u64 open_staged_file( FileStage *stage, const char *path );
+bool close_staged_file( FileStage *stage, u64 fileID );
+void discard_staged_file( FileStage *stage, u64 fileID );
+bool commit_staged_files( FileStage *stage );
 bool move_file( const char *from, const char *to, FileMove move = FILE_MOVE_ERROR_LOG );
 bool move_file_retry( const char *from, const char *to, FileMove move = FILE_MOVE_ERROR_LOG, i32 attempts = 3, i32 msWaitPerAttempt = 0 );
 bool copy_file( const char *from, const char *to, FileCopy copy = FILE_COPY_ERROR_LOG );
 bool copy_file_retry( const char *from, const char *to, FileCopy copy = FILE_COPY_ERROR_LOG, i32 attempts = 3, i32 msWaitPerAttempt = 0 );
 
+// Batched I/O, for many small files. Init fails without io_uring, so there always has to be a
+// way back to the functions above. A file that fails a step keeps its error and the rest of
+// the batch carries on. A batch only fails as a whole if the ring does, and then it is done for
+bool file_ring_init( FileRing *ring, u64 bufferSize, Allocator *allocator );
+void file_ring_free( FileRing *ring );
+bool file_ring_stat( FileRing *ring, RingFile *files, u64 count );
+bool file_ring_read( FileRing *ring, RingFile *files, u64 count );
+bool file_ring_write( FileRing *ring, RingFile *files, u64 count, bool timestamps );
+
 // Saving/Loading
 bool save_file( const char *path, void *data, u64 size, FileHeader *header, Allocator *allocator );
 [[nodiscard]] u8 *load_file( const char *path, u64 *fileSize, FileHeader *header, Allocator *allocator );
@@ -125,12 +224,15 @@ bool save_file( const char *path, void *data, u64 size, FileHeader *header, Allo
 #if defined( _WIN32 )
 
 	#include <direct.h>
+	#include <fcntl.h>
+	#include <io.h>
 	#include "dirent/dirent.h"
 
 	static_assert( MAX_FILEPATH >= MAX_PATH );
 
 	#define finternal_stat_struct		struct _stat64
 	#define finternal_stat				_stat64
+	#define finternal_fstat				_fstat64
 	#define finternal_mkdir( p, m )		_mkdir( p )
 	#define finternal_seek				_fseeki64
 	#define finternal_ftell				_ftelli64
@@ -139,14 +241,27 @@ bool save_file( const char *path, void *data, u64 size, FileHeader *header, Allo
 	#define finternal_chdir				_chdir
 	#define finternal_getcwd			_getcwd
 	#define finternal_rename			rename
+	#define finternal_fileno			_fileno
+	#define finternal_truncate( f, s )	( _chsize_s( f, s ) == 0 )
 
 #else
 
 	#include <dirent.h>
+	#include <errno.h>
+	#include <fcntl.h>
+	#include <limits.h>
+	#include <stddef.h>
+	#include <unistd.h>
 	#include <sys/stat.h>
+	#include <sys/uio.h>
+
+	static_assert( sizeof( FileSpan ) == sizeof( struct iovec ) );
+	static_assert( offsetof( FileSpan, data ) == offsetof( struct iovec, iov_base ) );
+	static_assert( offsetof( FileSpan, size ) == offsetof( struct iovec, iov_len ) );
 
 	#define finternal_stat_struct		struct stat64
 	#define finternal_stat				stat64
+	#define finternal_fstat				fstat64
 	#define finternal_mkdir( p, m )		mkdir( p, m )
 	#define finternal_seek				fseeko
 	#define finternal_ftell				ftello
@@ -155,6 +270,8 @@ bool save_file( const char *path, void *data, u64 size, FileHeader *header, Allo
 	#define finternal_chdir				chdir
 	#define finternal_getcwd			getcwd
 	#define finternal_rename			rename
+	#define finternal_fileno			fileno
+	#define finternal_truncate( f, s )	( ftruncate( f, s ) == 0 )
 
 #endif
 
@@ -219,6 +336,9 @@ char *handle_file_includes( const char *root, char *code, u64 codeSize, Allocato
 						// Paste the included file, it will overwrite the #include instruction
 						buffer.paste( i, includedCode, includedFileSize );
 						code = lhs + size + 1;
+
+						// Only reclaimed by a bump allocator while nothing came after it, a pool always takes it back
+						allocator->free( includedCode );
 					}
 				}
 			}
@@ -416,7 +536,7 @@ bool change_directory( const char *directory )
  
 [[nodiscard]] char *get_directory()
 {
-	Allocator *allocator = &platform->memory.transient;
+	Allocator *allocator = &memory->transient;
 
 	u32 bufferSize = PATH_MAX;
 
@@ -552,6 +672,187 @@ const char *abs_path( const char *path, Allocator *allocator )
 	return buffer;
 }
 
+// Directory walk, each directory and file found is a task on a thread queue. Directories are
+// opened relative to their parent's handle, which stays open while any child still needs it
+struct DirectoryWalkHandle
+{
+	std::atomic<u32> references;
+	DIR *dir;
+};
+
+struct DirectoryWalkTask
+{
+	ThreadQueueNode node;
+	DirectoryWalkHandle *parent;		// null for a root, which is opened by its path
+	const char *name;					// points into path, just past the parent's part
+	bool directory;
+	char path[ 1 ];						// allocated to fit
+};
+
+struct DirectoryWalk
+{
+	ThreadQueue queue;
+	DirectoryWalkFilterFunc filter_func;
+	DirectoryWalkFileFunc file_func;
+	void *user;
+};
+
+static void directory_walk_release( DirectoryWalkHandle *handle )
+{
+	if ( handle && handle->references.fetch_sub( 1, std::memory_order_acq_rel ) == 1 )
+	{
+		closedir( handle->dir );
+		delete handle;
+	}
+}
+
+static bool directory_walk_push( DirectoryWalk *walk, DirectoryWalkHandle *parent, const char *path, const char *name, bool directory )
+{
+	// Bytes without the null terminators
+	u64 pathBytes = string_utf8_bytes( path ) - 1;
+	u64 nameBytes = ( name ? string_utf8_bytes( name ) - 1 : 0 );
+	u64 separator = ( name && pathBytes > 0 && path[ pathBytes - 1 ] != '/' ? 1 : 0 );
+	u64 size = pathBytes + separator + nameBytes;
+
+	if ( size >= MAX_FILEPATH )
+	{
+		log_warning( "Path too long: %s/%s", path, name ? name : "" );
+		return false;
+	}
+
+	DirectoryWalkTask *task = static_cast<DirectoryWalkTask *>( malloc( sizeof( DirectoryWalkTask ) + size ) );
+	if ( !task )
+		return false;
+
+	memcpy( task->path, path, pathBytes );
+
+	if ( name )
+	{
+		if ( separator )
+			task->path[ pathBytes ] = '/';
+
+		memcpy( task->path + pathBytes + separator, name, nameBytes );
+	}
+
+	task->path[ size ] = '\0';
+	task->name = ( name ? task->path + pathBytes + separator : task->path );
+	task->directory = directory;
+	task->parent = parent;
+
+	if ( parent )
+		parent->references.fetch_add( 1, std::memory_order_relaxed );
+
+	thread_queue_push( &walk->queue, &task->node );
+
+	return true;
+}
+
+static DIR *directory_walk_open( DirectoryWalkTask *task )
+{
+	#if defined( _WIN32 )
+		return opendir( task->path );
+	#else
+		i32 parentFD = ( task->parent ? dirfd( task->parent->dir ) : AT_FDCWD );
+		i32 fd = openat( parentFD, task->name, O_RDONLY | O_DIRECTORY | O_CLOEXEC | O_NOFOLLOW );
+
+		if ( fd < 0 )
+			return nullptr;
+
+		DIR *dir = fdopendir( fd );
+
+		if ( !dir )
+			close( fd );
+
+		return dir;
+	#endif
+}
+
+static void directory_walk_task( ThreadQueueNode *node, u32 worker, void *user )
+{
+	DirectoryWalk *walk = static_cast<DirectoryWalk *>( user );
+	DirectoryWalkTask *task = reinterpret_cast<DirectoryWalkTask *>( node );
+
+	if ( !task->directory )
+	{
+		walk->file_func( task->path, worker, walk->user );
+		directory_walk_release( task->parent );
+		::free( task );
+		return;
+	}
+
+	trace_begin( "walk directory" );
+
+	DIR *dir = directory_walk_open( task );
+	directory_walk_release( task->parent );
+
+	if ( !dir )
+	{
+		log_warning( "Failed to open directory: %s", task->path );
+		::free( task );
+		trace_end( "walk directory" );
+		return;
+	}
+
+	// This task holds one reference until it has listed everything
+	DirectoryWalkHandle *handle = new DirectoryWalkHandle;
+	handle->references.store( 1, std::memory_order_relaxed );
+	handle->dir = dir;
+
+	struct dirent *entry;
+
+	while ( ( entry = readdir( dir ) ) )
+	{
+		const char *name = entry->d_name;
+
+		// Also skips . and .., and hidden trees like .git
+		if ( name[ 0 ] == '.' )
+			continue;
+
+		// The listing has the type on most file systems, only the rest are stat'd
+		u32 type = entry->d_type;
+
+		#if !defined( _WIN32 )
+			if ( type == DT_UNKNOWN )
+			{
+				struct stat st;
+
+				if ( fstatat( dirfd( dir ), name, &st, AT_SYMLINK_NOFOLLOW ) != 0 )
+					continue;
+
+				type = ( S_ISDIR( st.st_mode ) ? DT_DIR : S_ISREG( st.st_mode ) ? DT_REG : DT_UNKNOWN );
+			}
+		#endif
+
+		// Symbolic links aren't followed, so the walk can't loop
+		if ( type == DT_DIR )
+			directory_walk_push( walk, handle, task->path, name, true );
+		else if ( type == DT_REG && ( !walk->filter_func || walk->filter_func( name ) ) )
+			directory_walk_push( walk, handle, task->path, name, false );
+	}
+
+	directory_walk_release( handle );
+	::free( task );
+
+	trace_end( "walk directory" );
+}
+
+bool walk_directories( const char *const *roots, u64 rootCount, u32 workerCount, DirectoryWalkFilterFunc filter_func, DirectoryWalkFileFunc file_func, void *user )
+{
+	DirectoryWalk walk;
+	walk.filter_func = filter_func;
+	walk.file_func = file_func;
+	walk.user = user;
+
+	bool result = true;
+
+	for ( u64 i = 0; i < rootCount; ++i )
+		result = directory_walk_push( &walk, nullptr, roots[ i ], nullptr, true ) && result;
+
+	thread_queue_run( &walk.queue, workerCount, directory_walk_task, &walk );
+
+	return result;
+}
+
 [[nodiscard]] bool file_exists( const char *path )
 {
 	finternal_stat_struct st;
@@ -563,6 +864,17 @@ const char *abs_path( const char *path, Allocator *allocator )
 	return S_ISREG( st.st_mode );
 }
 
+[[nodiscard]] u64 file_size( const char *path )
+{
+	finternal_stat_struct st;
+	bool success = finternal_stat( path, &st ) == 0;
+
+	if ( !success )
+		return 0;
+
+	return st.st_size;
+}
+
 [[nodiscard]] u8 *read_file( const char *path, u64 *fileSize, bool addNullTerminator, Allocator *allocator )
 {
 	FILE *file = fopen( path, "rb" );
@@ -649,6 +961,33 @@ u64 write_file( const char *path, const u8 *buffer, u64 size, bool append )
 	return bytesWritten;
 }
 
+u64 write_file_spans( const char *path, const FileSpan *spans, u64 count, bool append )
+{
+	u64 fileID = open_file( path, FILE_OPTION_WRITE | FILE_OPTION_CREATE | ( append ? FILE_OPTION_APPEND : FILE_OPTION_CLEAR ) );
+
+	if ( fileID == INVALID_FILE_INDEX )
+	{
+		log_warning( "Failed to open file: \"%s\"", path );
+		return 0;
+	}
+
+	u64 size = 0;
+	for ( u64 i = 0; i < count; ++i )
+		size += spans[ i ].size;
+
+	u64 bytesWritten = write_to_file_spans( fileID, spans, count );
+
+	close_file( fileID );
+
+	if ( size != bytesWritten )
+	{
+		log_warning( "Failed to write file: \"%s\"", path );
+		return 0;
+	}
+
+	return bytesWritten;
+}
+
 bool delete_file( const char *path )
 {
 	return finternal_unlink( path ) == 0;
@@ -899,6 +1238,16 @@ u64 read_from_file( u64 fileID, void *buffer, u64 size )
 	return bytesRead;
 }
 
+// Fills the buffer unless the file ends first, which is not a failure. file_error tells them apart
+u64 read_from_file_partial( u64 fileID, void *buffer, u64 size )
+{
+	FILE *file = reinterpret_cast<FILE *>( fileID );
+	if ( !file )
+		return 0;
+
+	return fread( buffer, 1, size, file );
+}
+
 u64 write_to_file( u64 fileID, const void *buffer, u64 size )
 {
 	FILE *file = reinterpret_cast<FILE *>( fileID );
@@ -916,6 +1265,94 @@ u64 write_to_file( u64 fileID, const void *buffer, u64 size )
 	return bytesWritten;
 }
 
+u64 write_to_file_spans( u64 fileID, const FileSpan *spans, u64 count )
+{
+	FILE *file = reinterpret_cast<FILE *>( fileID );
+	if ( !file )
+		return 0;
+
+	u64 bytesWritten = 0;
+
+	#ifdef _WIN32
+
+		for ( u64 i = 0; i < count; ++i )
+		{
+			u64 written = fwrite( spans[ i ].data, 1, spans[ i ].size, file );
+			bytesWritten += written;
+
+			if ( written != spans[ i ].size )
+			{
+				log_warning( "Failed to write to fileID: %" PRIu64, fileID );
+				return 0;
+			}
+		}
+
+	#else
+
+		// Anything still buffered has to go first, the spans bypass the FILE buffer
+		fflush( file );
+
+		i32 fd = fileno( file );
+		const struct iovec *iov = reinterpret_cast<const struct iovec *>( spans );
+
+		while ( count > 0 )
+		{
+			i32 batch = static_cast<i32>( count < IOV_MAX ? count : IOV_MAX );
+			ssize_t written = writev( fd, iov, batch );
+
+			if ( written < 0 )
+			{
+				if ( errno == EINTR )
+					continue;
+
+				log_warning( "Failed to write to fileID: %" PRIu64, fileID );
+				return 0;
+			}
+
+			bytesWritten += written;
+
+			// Move past the spans that were fully written
+			while ( count > 0 && static_cast<u64>( written ) >= iov->iov_len )
+			{
+				written -= iov->iov_len;
+				iov += 1;
+				count -= 1;
+			}
+
+			// Finish off a partially written span before the next batch
+			if ( written > 0 )
+			{
+				const u8 *rest = static_cast<const u8 *>( iov->iov_base ) + written;
+				u64 restSize = iov->iov_len - written;
+
+				while ( restSize > 0 )
+				{
+					ssize_t w = write( fd, rest, restSize );
+
+					if ( w < 0 && errno == EINTR )
+						continue;
+
+					if ( w <= 0 )
+					{
+						log_warning( "Failed to write to fileID: %" PRIu64, fileID );
+						return 0;
+					}
+
+					rest += w;
+					restSize -= w;
+					bytesWritten += w;
+				}
+
+				iov += 1;
+				count -= 1;
+			}
+		}
+
+	#endif
+
+	return bytesWritten;
+}
+
 void file_flush( u64 fileID )
 {
 	FILE *file = reinterpret_cast<FILE *>( fileID );
@@ -923,6 +1360,668 @@ void file_flush( u64 fileID )
 		fflush( file );
 }
 
+bool file_error( u64 fileID )
+{
+	FILE *file = reinterpret_cast<FILE *>( fileID );
+	return !file || ferror( file ) != 0;
+}
+
+static u64 file_standard_open( FILE *file )
+{
+#if defined( _WIN32 )
+	// Text mode would turn every \n into \r\n
+	_setmode( _fileno( file ), _O_BINARY );
+#endif
+
+	setvbuf( file, nullptr, _IONBF, 0 );
+	return reinterpret_cast<u64>( file );
+}
+
+u64 open_standard_input()
+{
+	return file_standard_open( stdin );
+}
+
+u64 open_standard_output()
+{
+	return file_standard_open( stdout );
+}
+
+bool truncate_file( u64 fileID, u64 size )
+{
+	FILE *file = reinterpret_cast<FILE *>( fileID );
+	if ( !file )
+		return false;
+
+	// Anything still buffered has to land before the size is cut
+	fflush( file );
+
+	if ( !finternal_truncate( finternal_fileno( file ), size ) )
+	{
+		log_warning( "Failed to truncate fileID: %" PRIu64 " ( %" PRIu64 " bytes )", fileID, size );
+		return false;
+	}
+
+	return true;
+}
+
+[[nodiscard]] u64 get_file_last_edit_timestamp( u64 fileID )
+{
+	FILE *file = reinterpret_cast<FILE *>( fileID );
+	if ( !file )
+		return 0;
+
+	// Buffered writes still to come would move it on
+	fflush( file );
+
+	finternal_stat_struct st;
+	bool success = finternal_fstat( finternal_fileno( file ), &st ) == 0;
+
+	if ( !success )
+		return 0;
+
+	return st.st_mtime;
+}
+
+#if !defined( _WIN32 )
+// The directory a path is in, where its temporary file goes and what its file system is synced through
+static void staged_file_directory( const char *path, char *directory, u64 directorySize )
+{
+	const char *slash = strrchr( path, '/' );
+
+	if ( slash )
+		snprintf( directory, directorySize, "%.*s", static_cast<i32>( slash - path + 1 ), path );
+	else
+		snprintf( directory, directorySize, "." );
+}
+#endif
+
+u64 open_staged_file( FileStage *stage, const char *path )
+{
+	if ( stage->count == MAX_STAGED_FILES && !commit_staged_files( stage ) )
+		log_warning( "Failed to commit every staged file." );
+
+	StagedFile *staged = &stage->files[ stage->count ];
+
+	if ( snprintf( staged->path, sizeof( staged->path ), "%s", path ) >= static_cast<i32>( sizeof( staged->path ) ) )
+	{
+		log_warning( "Path too long: %s", path );
+		return INVALID_FILE_INDEX;
+	}
+
+	finternal_stat_struct st;
+	bool exists = finternal_stat( path, &st ) == 0;
+
+	#if defined( _WIN32 )
+		char tempPath[ MAX_FILEPATH ];
+		snprintf( tempPath, sizeof( tempPath ), "%s.TEMP", path );
+
+		FILE *file = fopen( tempPath, "wb" );
+		staged->named = true;
+		staged->device = 0;
+	#else
+		i32 fd = -1;
+		staged->named = false;
+
+		// An unnamed file in the same directory, so it can be renamed into place and a crash
+		// before then leaves nothing behind. Not every file system has them
+		#if defined( O_TMPFILE )
+		{
+			char directory[ MAX_FILEPATH ];
+			staged_file_directory( path, directory, sizeof( directory ) );
+
+			fd = open( directory, O_TMPFILE | O_WRONLY | O_CLOEXEC, 0644 );
+		}
+		#endif
+
+		if ( fd < 0 )
+		{
+			char tempPath[ MAX_FILEPATH ];
+			snprintf( tempPath, sizeof( tempPath ), "%s.TEMP", path );
+
+			fd = open( tempPath, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644 );
+			staged->named = true;
+		}
+
+		// It replaces the file, so it keeps its permissions
+		if ( fd >= 0 && exists )
+			fchmod( fd, st.st_mode & 07777 );
+
+		struct stat fdStat;
+		staged->device = ( fd >= 0 && fstat( fd, &fdStat ) == 0 ? fdStat.st_dev : 0 );
+
+		FILE *file = ( fd >= 0 ? fdopen( fd, "wb" ) : nullptr );
+
+		if ( fd >= 0 && !file )
+			close( fd );
+	#endif
+
+	if ( !file )
+	{
+		log_warning( "Failed to stage file: \"%s\"", path );
+		return INVALID_FILE_INDEX;
+	}
+
+	staged->fileID = reinterpret_cast<u64>( file );
+	stage->count += 1;
+
+	return staged->fileID;
+}
+
+static void staged_file_remove( FileStage *stage, u64 index )
+{
+	StagedFile *staged = &stage->files[ index ];
+
+	if ( staged->fileID )
+		close_file( staged->fileID );
+
+	if ( staged->named )
+	{
+		char tempPath[ MAX_FILEPATH ];
+		snprintf( tempPath, sizeof( tempPath ), "%s.TEMP", staged->path );
+		finternal_unlink( tempPath );
+	}
+
+	stage->files[ index ] = stage->files[ --stage->count ];
+}
+
+bool close_staged_file( FileStage *stage, u64 fileID )
+{
+	u64 index = 0;
+
+	while ( index < stage->count && stage->files[ index ].fileID != fileID )
+		index += 1;
+
+	if ( index == stage->count )
+		return false;
+
+	StagedFile *staged = &stage->files[ index ];
+	FILE *file = reinterpret_cast<FILE *>( staged->fileID );
+
+	bool result = ( fflush( file ) == 0 );
+
+	#if defined( _WIN32 )
+		// No file system wide sync, so each file is committed on its own before it is let go of
+		result = result && ( _commit( _fileno( file ) ) == 0 );
+	#else
+		// An unnamed file would be gone once it is closed, so it is linked to its temporary name
+		// first. It can only be linked to a name that is free, and renamed over the target from there
+		if ( result && !staged->named )
+		{
+			char tempPath[ MAX_FILEPATH ];
+			snprintf( tempPath, sizeof( tempPath ), "%s.TEMP", staged->path );
+
+			char procPath[ 64 ];
+			snprintf( procPath, sizeof( procPath ), "/proc/self/fd/%d", fileno( file ) );
+
+			finternal_unlink( tempPath );
+			staged->named = ( linkat( AT_FDCWD, procPath, AT_FDCWD, tempPath, AT_SYMLINK_FOLLOW ) == 0 );
+			result = staged->named;
+		}
+	#endif
+
+	result = ( fclose( file ) == 0 ) && result;
+	staged->fileID = 0;
+
+	if ( !result )
+	{
+		log_warning( "Failed to stage file: \"%s\"", staged->path );
+		staged_file_remove( stage, index );
+	}
+
+	return result;
+}
+
+void discard_staged_file( FileStage *stage, u64 fileID )
+{
+	for ( u64 i = 0; i < stage->count; ++i )
+	{
+		if ( stage->files[ i ].fileID == fileID )
+		{
+			staged_file_remove( stage, i );
+			return;
+		}
+	}
+}
+
+// Syncs each file system in the stage once, through the directory of the first file on it.
+// Windows has no file system wide sync, its files were committed as they were closed
+static bool staged_files_sync( FileStage *stage )
+{
+	bool result = true;
+
+	#if !defined( _WIN32 )
+		for ( u64 i = 0; i < stage->count; ++i )
+		{
+			StagedFile *staged = &stage->files[ i ];
+			bool synced = false;
+
+			for ( u64 j = 0; j < i && !synced; ++j )
+				synced = ( stage->files[ j ].device == staged->device );
+
+			if ( synced )
+				continue;
+
+			char directory[ MAX_FILEPATH ];
+			staged_file_directory( staged->path, directory, sizeof( directory ) );
+
+			i32 fd = open( directory, O_RDONLY | O_DIRECTORY | O_CLOEXEC );
+			result = ( fd >= 0 && syncfs( fd ) == 0 ) && result;
+
+			if ( fd >= 0 )
+				close( fd );
+		}
+	#else
+		(void)stage;
+	#endif
+
+	return result;
+}
+
+bool commit_staged_files( FileStage *stage )
+{
+	if ( stage->count == 0 )
+		return true;
+
+	// A file that is still open was never finished, so it isn't published
+	for ( u64 i = stage->count; i-- > 0; )
+	{
+		if ( stage->files[ i ].fileID )
+			staged_file_remove( stage, i );
+	}
+
+	bool result = true;
+
+	// Nothing is published until everything in the stage is on disk
+	if ( !staged_files_sync( stage ) )
+	{
+		log_warning( "Failed to sync staged files, none were published." );
+
+		while ( stage->count > 0 )
+			staged_file_remove( stage, stage->count - 1 );
+
+		return false;
+	}
+
+	for ( u64 i = 0; i < stage->count; ++i )
+	{
+		StagedFile *staged = &stage->files[ i ];
+
+		char tempPath[ MAX_FILEPATH ];
+		snprintf( tempPath, sizeof( tempPath ), "%s.TEMP", staged->path );
+
+		#if defined( _WIN32 )
+			bool published = move_file( tempPath, staged->path, FILE_MOVE_REPLACE );
+		#else
+			bool published = ( finternal_rename( tempPath, staged->path ) == 0 );
+		#endif
+
+		if ( !published )
+		{
+			log_warning( "Failed to publish staged file: \"%s\"", staged->path );
+
+			if ( staged->named )
+				finternal_unlink( tempPath );
+
+			result = false;
+		}
+
+		staged->named = false;
+	}
+
+	// The renames are durable too before the stage is reused
+	result = staged_files_sync( stage ) && result;
+
+	stage->count = 0;
+
+	return result;
+}
+
+// Batched I/O, only on Linux
+#if defined( __linux__ )
+
+	#include <linux/io_uring.h>
+	#include <sys/mman.h>
+	#include <sys/syscall.h>
+
+using FileRingStep = u64;
+enum FILE_RING_STEP : FileRingStep
+{
+	FILE_RING_STEP_STAT,
+	FILE_RING_STEP_OPEN,
+	FILE_RING_STEP_READ,
+	FILE_RING_STEP_WRITE,
+	FILE_RING_STEP_CLOSE,
+	FILE_RING_STEP_TIMESTAMP,			// stat once a write is closed
+};
+
+// A write takes the most steps, open, write, close and stat
+constexpr const u32 FILE_RING_DEPTH = static_cast<u32>( FILE_RING_BATCH_SIZE * 4 );
+
+bool file_ring_init( FileRing *ring, u64 bufferSize, Allocator *allocator )
+{
+	*ring = {};
+	ring->fd = -1;
+
+	struct io_uring_params params = {};
+	i32 fd = static_cast<i32>( syscall( __NR_io_uring_setup, FILE_RING_DEPTH, &params ) );
+
+	if ( fd < 0 )
+		return false;
+
+	ring->fd = fd;
+
+	// Opening into the ring's table for the next step to use came in with 5.15. There is no
+	// flag for it, skipping completions came soon after and has one
+	if ( !( params.features & IORING_FEAT_SINGLE_MMAP ) || !( params.features & IORING_FEAT_CQE_SKIP ) )
+	{
+		file_ring_free( ring );
+		return false;
+	}
+
+	ring->ringsSize = max<u64>( params.sq_off.array + params.sq_entries * sizeof( u32 ), params.cq_off.cqes + params.cq_entries * sizeof( struct io_uring_cqe ) );
+	ring->sqesSize = params.sq_entries * sizeof( struct io_uring_sqe );
+
+	void *rings = mmap( nullptr, ring->ringsSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING );
+	void *sqes = mmap( nullptr, ring->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES );
+
+	ring->rings = ( rings != MAP_FAILED ? static_cast<u8 *>( rings ) : nullptr );
+	ring->sqes = ( sqes != MAP_FAILED ? static_cast<struct io_uring_sqe *>( sqes ) : nullptr );
+
+	if ( !ring->rings || !ring->sqes )
+	{
+		file_ring_free( ring );
+		return false;
+	}
+
+	ring->sqTail = reinterpret_cast<u32 *>( ring->rings + params.sq_off.tail );
+	ring->sqArray = reinterpret_cast<u32 *>( ring->rings + params.sq_off.array );
+	ring->sqMask = *reinterpret_cast<u32 *>( ring->rings + params.sq_off.ring_mask );
+	ring->cqHead = reinterpret_cast<u32 *>( ring->rings + params.cq_off.head );
+	ring->cqTail = reinterpret_cast<u32 *>( ring->rings + params.cq_off.tail );
+	ring->cqMask = *reinterpret_cast<u32 *>( ring->rings + params.cq_off.ring_mask );
+	ring->cqes = reinterpret_cast<struct io_uring_cqe *>( ring->rings + params.cq_off.cqes );
+
+	ring->allocator = allocator;
+	ring->buffer = allocator->allocate<u8>( bufferSize, false, 4096 );
+	ring->stats = allocator->allocate<struct statx>( FILE_RING_BATCH_SIZE );
+
+	if ( !ring->buffer || !ring->stats )
+	{
+		file_ring_free( ring );
+		return false;
+	}
+
+	ring->bufferSize = bufferSize;
+
+	// Every slot starts empty, opening a file fills one
+	i32 slots[ FILE_RING_BATCH_SIZE ];
+	for ( i32 &slot : slots )
+		slot = -1;
+
+	if ( syscall( __NR_io_uring_register, fd, IORING_REGISTER_FILES, slots, FILE_RING_BATCH_SIZE ) != 0 )
+	{
+		file_ring_free( ring );
+		return false;
+	}
+
+	// Pinned memory counts against the locked memory limit, which is small on some systems.
+	// Plain reads and writes work just as well without it
+	struct iovec buffer = { ring->buffer, bufferSize };
+	ring->registered = ( syscall( __NR_io_uring_register, fd, IORING_REGISTER_BUFFERS, &buffer, 1 ) == 0 );
+
+	return true;
+}
+
+void file_ring_free( FileRing *ring )
+{
+	// Closing the ring drops what was registered with it
+	if ( ring->fd >= 0 )
+		close( ring->fd );
+
+	if ( ring->sqes )
+		munmap( ring->sqes, ring->sqesSize );
+
+	if ( ring->rings )
+		munmap( ring->rings, ring->ringsSize );
+
+	if ( ring->allocator )
+	{
+		ring->allocator->free( ring->stats );
+		ring->allocator->free( ring->buffer );
+	}
+
+	*ring = {};
+	ring->fd = -1;
+}
+
+static struct io_uring_sqe *file_ring_queue( FileRing *ring, u8 opcode, u64 index, FileRingStep step, u8 flags )
+{
+	// Every batch is waited for, so the kernel has always taken the last one
+	assert( ring->queued < FILE_RING_DEPTH );
+
+	u32 tail = *ring->sqTail + ring->queued;
+	u32 entry = tail & ring->sqMask;
+	struct io_uring_sqe *sqe = &ring->sqes[ entry ];
+
+	memset( sqe, 0, sizeof( *sqe ) );
+	sqe->opcode = opcode;
+	sqe->flags = flags;
+	sqe->user_data = ( index << 8 ) | step;
+
+	ring->sqArray[ entry ] = entry;
+	ring->queued += 1;
+
+	return sqe;
+}
+
+static void file_ring_complete( FileRing *ring, RingFile *file, u64 index, FileRingStep step, i32 result )
+{
+	// The steps of a file are hard linked, so they all run and the first error is the one kept
+	if ( result < 0 )
+	{
+		if ( !file->error )
+			file->error = -result;
+
+		return;
+	}
+
+	switch ( step )
+	{
+		case FILE_RING_STEP_STAT:
+		{
+			const struct statx *st = &ring->stats[ index ];
+
+			if ( !S_ISREG( st->stx_mode ) )
+				file->error = EINVAL;
+
+			file->size = st->stx_size;
+			file->timestamp = st->stx_mtime.tv_sec;
+			break;
+		}
+
+		case FILE_RING_STEP_TIMESTAMP:
+			file->timestamp = ring->stats[ index ].stx_mtime.tv_sec;
+			break;
+
+		// One byte more than the stat said is asked for, so a file that has grown is caught
+		case FILE_RING_STEP_READ:
+		case FILE_RING_STEP_WRITE:
+			if ( static_cast<u64>( result ) != file->size && !file->error )
+				file->error = EIO;
+			break;
+
+		default:
+			break;
+	}
+}
+
+// Queued steps are submitted and waited for until every one of them has completed
+static bool file_ring_submit( FileRing *ring, RingFile *files, u64 count )
+{
+	u32 submitted = ring->queued;
+	u32 remaining = submitted;
+	u32 completed = 0;
+
+	__atomic_store_n( ring->sqTail, *ring->sqTail + submitted, __ATOMIC_RELEASE );
+	ring->queued = 0;
+
+	while ( completed < submitted )
+	{
+		i64 result = syscall( __NR_io_uring_enter, ring->fd, remaining, submitted - completed, IORING_ENTER_GETEVENTS, nullptr, 0 );
+
+		if ( result < 0 )
+		{
+			if ( errno == EINTR )
+				continue;
+
+			i32 error = errno;
+			log_warning( "io_uring failed ( %s )", strerror( error ) );
+
+			for ( u64 i = 0; i < count; ++i )
+			{
+				if ( !files[ i ].error )
+					files[ i ].error = error;
+			}
+
+			return false;
+		}
+
+		remaining -= static_cast<u32>( result );
+
+		u32 head = *ring->cqHead;
+		u32 tail = __atomic_load_n( ring->cqTail, __ATOMIC_ACQUIRE );
+
+		for ( ; head != tail; ++head )
+		{
+			const struct io_uring_cqe *cqe = &ring->cqes[ head & ring->cqMask ];
+			u64 index = cqe->user_data >> 8;
+
+			file_ring_complete( ring, &files[ index ], index, cqe->user_data & 0xFF, cqe->res );
+			completed += 1;
+		}
+
+		__atomic_store_n( ring->cqHead, head, __ATOMIC_RELEASE );
+	}
+
+	return true;
+}
+
+bool file_ring_stat( FileRing *ring, RingFile *files, u64 count )
+{
+	assert( count <= FILE_RING_BATCH_SIZE );
+
+	for ( u64 i = 0; i < count; ++i )
+	{
+		RingFile *file = &files[ i ];
+		file->data = nullptr;
+		file->size = 0;
+		file->timestamp = 0;
+		file->error = 0;
+
+		struct io_uring_sqe *sqe = file_ring_queue( ring, IORING_OP_STATX, i, FILE_RING_STEP_STAT, 0 );
+		sqe->fd = AT_FDCWD;
+		sqe->addr = reinterpret_cast<u64>( file->path );
+		sqe->len = STATX_TYPE | STATX_SIZE | STATX_MTIME;
+		sqe->off = reinterpret_cast<u64>( &ring->stats[ i ] );
+	}
+
+	return file_ring_submit( ring, files, count );
+}
+
+// The read or write goes between an open and a close, each file using the slot of its index
+static void file_ring_queue_io( FileRing *ring, const RingFile *file, u64 index, bool write, bool timestamp )
+{
+	assert( file->data >= ring->buffer && file->data + file->size + ( write ? 0 : 1 ) <= ring->buffer + ring->bufferSize );
+
+	// A file opened into the ring's table never has a descriptor, so it can't be asked to close on exec
+	struct io_uring_sqe *sqe = file_ring_queue( ring, IORING_OP_OPENAT, index, FILE_RING_STEP_OPEN, IOSQE_IO_HARDLINK );
+	sqe->fd = AT_FDCWD;
+	sqe->addr = reinterpret_cast<u64>( file->path );
+	sqe->open_flags = ( write ? O_WRONLY | O_CREAT | O_TRUNC : O_RDONLY );
+	sqe->len = ( write ? 0666 : 0 );
+	sqe->file_index = static_cast<u32>( index + 1 );
+
+	u8 opcode = ( write
+		? ( ring->registered ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE )
+		: ( ring->registered ? IORING_OP_READ_FIXED : IORING_OP_READ ) );
+
+	sqe = file_ring_queue( ring, opcode, index, write ? FILE_RING_STEP_WRITE : FILE_RING_STEP_READ, IOSQE_FIXED_FILE | IOSQE_IO_HARDLINK );
+	sqe->fd = static_cast<i32>( index );
+	sqe->addr = reinterpret_cast<u64>( file->data );
+	sqe->len = static_cast<u32>( file->size + ( write ? 0 : 1 ) );
+	sqe->off = 0;
+	sqe->buf_index = 0;
+
+	sqe = file_ring_queue( ring, IORING_OP_CLOSE, index, FILE_RING_STEP_CLOSE, timestamp ? IOSQE_IO_HARDLINK : 0 );
+	sqe->file_index = static_cast<u32>( index + 1 );
+
+	if ( timestamp )
+	{
+		sqe = file_ring_queue( ring, IORING_OP_STATX, index, FILE_RING_STEP_TIMESTAMP, 0 );
+		sqe->fd = AT_FDCWD;
+		sqe->addr = reinterpret_cast<u64>( file->path );
+		sqe->len = STATX_MTIME;
+		sqe->off = reinterpret_cast<u64>( &ring->stats[ index ] );
+	}
+}
+
+bool file_ring_read( FileRing *ring, RingFile *files, u64 count )
+{
+	assert( count <= FILE_RING_BATCH_SIZE );
+
+	for ( u64 i = 0; i < count; ++i )
+	{
+		if ( files[ i ].data && !files[ i ].error )
+			file_ring_queue_io( ring, &files[ i ], i, false, false );
+	}
+
+	return file_ring_submit( ring, files, count );
+}
+
+bool file_ring_write( FileRing *ring, RingFile *files, u64 count, bool timestamps )
+{
+	assert( count <= FILE_RING_BATCH_SIZE );
+
+	for ( u64 i = 0; i < count; ++i )
+	{
+		if ( files[ i ].data && !files[ i ].error )
+			file_ring_queue_io( ring, &files[ i ], i, true, timestamps );
+	}
+
+	return file_ring_submit( ring, files, count );
+}
+
+#else
+
+bool file_ring_init( FileRing *ring, u64 bufferSize, Allocator *allocator )
+{
+	*ring = {};
+	ring->fd = -1;
+	return false;
+}
+
+void file_ring_free( FileRing *ring )
+{
+}
+
+bool file_ring_stat( FileRing *ring, RingFile *files, u64 count )
+{
+	return false;
+}
+
+bool file_ring_read( FileRing *ring, RingFile *files, u64 count )
+{
+	return false;
+}
+
+bool file_ring_write( FileRing *ring, RingFile *files, u64 count, bool timestamps )
+{
+	return false;
+}
+
+#endif
+
 [[nodiscard]] u64 file_creation_timestamp( const char *path )
 {
 	finternal_stat_struct st;
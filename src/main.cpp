@@ -6,8 +6,1551 @@ enum ERROR_CODE
 	ERROR_CODE_NO_INPUT_FILES = -1,
 	ERROR_CODE_FAILED_TO_INITIALISE_MEMORY_ARENA = -2,
 	ERROR_CODE_FAILED_TO_INITIALISE_PLATFORM = -3,
+	ERROR_CODE_INVALID_ARGUMENTS = -4,
+	ERROR_CODE_FILTER_FAILED = -5,
 };
 
+// Stripping only ever drops bytes, so output the same size as the file is the file
+using StripResult = u8;
+enum STRIP_RESULT : StripResult
+{
+	STRIP_RESULT_FAILED,
+	STRIP_RESULT_WRITTEN,
+	STRIP_RESULT_UNCHANGED,			// nothing was stripped, the file wasn't opened for writing
+};
+
+// -------------------------------------------------------
+// TARGET
+// -------------------------------------------------------
+
+// Where a stripped file is written, and what it was once it has been
+struct StripTarget
+{
+	const char *filepath;
+	FileStage *stage;			// null unless writes are durable
+	ManifestHash *hash;			// null unless the output is being hashed
+	u64 written;				// bytes of output
+	u64 timestamp;				// last edit once written, only when hashing
+};
+
+// Written straight over the file, or staged to replace it when writes are durable
+static u64 strip_target_open( StripTarget *target )
+{
+	if ( target->stage )
+		return open_staged_file( target->stage, target->filepath );
+
+	return open_file( target->filepath, FILE_OPTION_WRITE | FILE_OPTION_CREATE | FILE_OPTION_CLEAR );
+}
+
+// A staged file is closed into the stage, which publishes it later, or thrown away if it wasn't
+// all written. Renaming it into place doesn't change when it was last edited, so the manifest can
+// be given that now. Returns whether the output was kept
+static bool strip_target_close( StripTarget *target, u64 fileID, bool written )
+{
+	if ( target->hash )
+		target->timestamp = get_file_last_edit_timestamp( fileID );
+
+	if ( !target->stage )
+	{
+		close_file( fileID );
+		return written;
+	}
+
+	if ( !written )
+	{
+		discard_staged_file( target->stage, fileID );
+		return false;
+	}
+
+	return close_staged_file( target->stage, fileID );
+}
+
+// -------------------------------------------------------
+// STATS
+// -------------------------------------------------------
+
+using StripPhase = u8;
+enum STRIP_PHASE : StripPhase
+{
+	STRIP_PHASE_READ,
+	STRIP_PHASE_STRIP,
+	STRIP_PHASE_WRITE,
+	STRIP_PHASE_COUNT,
+};
+
+constexpr const char *STRIP_PHASE_NAMES[ STRIP_PHASE_COUNT ] =
+{
+	"read",
+	"strip",
+	"write",
+};
+
+using StripStatsFormat = u8;
+enum STRIP_STATS_FORMAT : StripStatsFormat
+{
+	STRIP_STATS_FORMAT_TEXT,
+	STRIP_STATS_FORMAT_JSON,
+};
+
+struct StripStatsFile
+{
+	StripStatsFile *next;
+	u64 bytesIn;
+	u64 bytesOut;
+	u64 ticks[ STRIP_PHASE_COUNT ];
+	StripResult result;
+	char path[ 1 ];			// allocated to fit
+};
+
+// One for each thread that reads, strips or writes, so nothing is shared while counting.
+// Phases are in ticks of the platform counter, summed over every file the thread saw
+struct StripStats
+{
+	u64 written;
+	u64 unchanged;
+	u64 failed;
+	u64 upToDate;
+	u64 bytesIn;
+	u64 bytesOut;
+	u64 ticks[ STRIP_PHASE_COUNT ];
+	u64 fileTicks[ STRIP_PHASE_COUNT ];		// of the file in hand, until it is recorded
+	MemoryArena *arena;						// null unless every file is recorded, shared by every thread
+	StripStatsFile *head;
+	StripStatsFile *tail;
+};
+
+// Null unless --stats is given, which is all a run without it ever checks. Each thread that
+// strips sets its own
+static thread_local StripStats *stats = nullptr;
+
+// Every phase is also a span on the --trace timeline
+[[nodiscard]] static inline u64 strip_stats_start( StripPhase phase )
+{
+	trace_begin( STRIP_PHASE_NAMES[ phase ] );
+
+	return ( stats ? platform_get_tick_counter() : 0 );
+}
+
+static inline void strip_stats_stop( StripPhase phase, u64 start )
+{
+	trace_end( STRIP_PHASE_NAMES[ phase ] );
+
+	if ( !stats )
+		return;
+
+	u64 ticks = platform_get_tick_counter() - start;
+	stats->ticks[ phase ] += ticks;
+	stats->fileTicks[ phase ] += ticks;
+}
+
+// Time that belongs to the run but to no one file, like a batch of reads
+static inline void strip_stats_stop_shared( StripPhase phase, u64 start )
+{
+	trace_end( STRIP_PHASE_NAMES[ phase ] );
+
+	if ( stats )
+		stats->ticks[ phase ] += platform_get_tick_counter() - start;
+}
+
+// A file that goes through more than one thread carries its time with it
+static inline void strip_stats_take( u64 ticks[ STRIP_PHASE_COUNT ] )
+{
+	for ( u32 phase = 0; phase < STRIP_PHASE_COUNT && stats; ++phase )
+	{
+		ticks[ phase ] += stats->fileTicks[ phase ];
+		stats->fileTicks[ phase ] = 0;
+	}
+}
+
+static inline void strip_stats_give( const u64 ticks[ STRIP_PHASE_COUNT ] )
+{
+	for ( u32 phase = 0; phase < STRIP_PHASE_COUNT && stats; ++phase )
+		stats->fileTicks[ phase ] += ticks[ phase ];
+}
+
+static void strip_stats_file( const char *filepath, StripResult result, u64 bytesIn, u64 bytesOut )
+{
+	if ( !stats )
+		return;
+
+	switch ( result )
+	{
+		case STRIP_RESULT_WRITTEN:		stats->written += 1; break;
+		case STRIP_RESULT_UNCHANGED:	stats->unchanged += 1; break;
+		default:						stats->failed += 1; break;
+	}
+
+	stats->bytesIn += bytesIn;
+	stats->bytesOut += bytesOut;
+
+	u64 pathBytes = string_utf8_bytes( filepath );
+	u64 fileBytes = offsetof( StripStatsFile, path ) + pathBytes;
+	StripStatsFile *file = ( stats->arena ? reinterpret_cast<StripStatsFile *>( stats->arena->permanent.allocate<u8>( fileBytes, false, alignof( StripStatsFile ) ) ) : nullptr );
+
+	if ( file )
+	{
+		file->next = nullptr;
+		file->bytesIn = bytesIn;
+		file->bytesOut = bytesOut;
+		file->result = result;
+		memcpy( file->ticks, stats->fileTicks, sizeof( file->ticks ) );
+		memcpy( file->path, filepath, pathBytes );
+
+		if ( stats->tail )
+			stats->tail->next = file;
+		else
+			stats->head = file;
+
+		stats->tail = file;
+	}
+	else if ( stats->arena )
+	{
+		log_warning( "Failed to allocate memory ( %" PRIu64 " bytes )", fileBytes );
+	}
+
+	memset( stats->fileTicks, 0, sizeof( stats->fileTicks ) );
+}
+
+// Files are recorded in an arena of their own, so a big tree doesn't crowd out the stripping.
+// Every thread records into the same one
+static MemoryArena *strip_stats_create_files( Allocator *allocator )
+{
+	MemoryArena *arena = allocator->allocate<MemoryArena>();
+
+	if ( arena )
+	{
+		*arena = memory_default();
+
+		if ( arena->init_virtual( GB( 4ull ), KB( 0 ), KB( 0 ), 0 ) )
+			memory_concurrent_init( &arena->permanent );
+		else
+			arena = nullptr;
+	}
+
+	if ( !arena )
+		log_warning( "Failed to initialise memory arena, files won't be listed." );
+
+	return arena;
+}
+
+static StripStats *strip_stats_create( Allocator *allocator, MemoryArena *files )
+{
+	StripStats *result = allocator->allocate<StripStats>( 1, true );
+
+	if ( result )
+		result->arena = files;
+
+	return result;
+}
+
+static void strip_stats_up_to_date()
+{
+	if ( !stats )
+		return;
+
+	stats->upToDate += 1;
+	memset( stats->fileTicks, 0, sizeof( stats->fileTicks ) );
+}
+
+static void strip_stats_print_json_string( const char *text )
+{
+	putchar( '"' );
+
+	for ( const u8 *c = reinterpret_cast<const u8 *>( text ); *c; ++c )
+	{
+		if ( *c == '"' || *c == '\\' )
+			printf( "\\%c", *c );
+		else if ( *c < 0x20 )
+			printf( "\\u%04x", *c );
+		else
+			putchar( *c );
+	}
+
+	putchar( '"' );
+}
+
+// Every worker's arena, an allocator that was never used is left out
+static void strip_stats_report_memory( MemoryArena *const *arenas, u32 arenaCount, StripStatsFormat format )
+{
+	constexpr const char *names[] = { "permanent", "transient", "fastBump", "pool" };
+	bool first = true;
+
+	for ( u32 worker = 0; worker < arenaCount; ++worker )
+	{
+		const Allocator *allocators[] = { &arenas[ worker ]->permanent, &arenas[ worker ]->transient, &arenas[ worker ]->fastBump, &arenas[ worker ]->pool };
+
+		for ( u32 i = 0; i < ARRAY_LENGTH( allocators ); ++i )
+		{
+			const AllocatorStats *memoryStats = &allocators[ i ]->stats;
+
+			if ( memoryStats->peak == 0 && memoryStats->allocations == 0 && memoryStats->failed == 0 )
+				continue;
+
+			// Huge pages are only asked for, this is how much of the block the kernel actually backed with them
+			bool huge = ( allocators[ i ]->flags & ALLOCATOR_FLAG_HUGE_PAGES ) != 0;
+			u64 hugeBytes = ( huge ? platform_memory_huge_bytes( allocators[ i ]->memory, allocators[ i ]->committed ) : 0 );
+
+			if ( format == STRIP_STATS_FORMAT_JSON )
+			{
+				printf( "%s\t\t{ \"worker\": %u, \"allocator\": \"%s\", \"capacity\": %" PRIu64 ", \"peak\": %" PRIu64 ", \"allocations\": %" PRIu64 ", \"frees\": %" PRIu64 ", \"failed\": %" PRIu64 ", \"bytes\": %" PRIu64 ", \"padding\": %" PRIu64 ", \"headers\": %" PRIu64 ", \"pages\": \"%s\", \"hugeBytes\": %" PRIu64 " }",
+					first ? ",\n\t\"memory\": [\n" : ",\n", worker, names[ i ], allocators[ i ]->capacity, memoryStats->peak, memoryStats->allocations, memoryStats->frees,
+					memoryStats->failed, memoryStats->bytes, memoryStats->padding, memoryStats->headers, huge ? "huge" : "normal", hugeBytes );
+			}
+			else
+			{
+				printf( "%s%-2u %-9s  peak %12" PRIu64 " of %12" PRIu64 "  allocations %9" PRIu64 "  frees %9" PRIu64 "  failed %" PRIu64 "  padding %10" PRIu64 "  headers %10" PRIu64 "  ",
+					first ? "Memory:\n  " : "  ", worker, names[ i ], memoryStats->peak, allocators[ i ]->capacity, memoryStats->allocations, memoryStats->frees,
+					memoryStats->failed, memoryStats->padding, memoryStats->headers );
+
+				if ( huge )
+					printf( "huge pages ( %" PRIu64 " bytes )\n", hugeBytes );
+				else
+					printf( "normal pages\n" );
+			}
+
+			first = false;
+		}
+	}
+
+	if ( format == STRIP_STATS_FORMAT_JSON && !first )
+		printf( "\n\t]" );
+}
+
+// Every thread's counts are added up for the run, but files are listed in the order each thread
+// saw them. Phases add up the time of every thread, so together they can come to more than the wall
+static void strip_stats_report( StripStats *const *threadStats, u32 threadCount, MemoryArena *const *arenas, u32 arenaCount, StripStatsFormat format )
+{
+	StripStats total = {};
+
+	for ( u32 i = 0; i < threadCount; ++i )
+	{
+		const StripStats *thread = threadStats[ i ];
+
+		total.written += thread->written;
+		total.unchanged += thread->unchanged;
+		total.failed += thread->failed;
+		total.upToDate += thread->upToDate;
+		total.bytesIn += thread->bytesIn;
+		total.bytesOut += thread->bytesOut;
+
+		for ( u32 phase = 0; phase < STRIP_PHASE_COUNT; ++phase )
+			total.ticks[ phase ] += thread->ticks[ phase ];
+	}
+
+	u64 wallTicks = platform_get_tick_counter() - platform->startCycles;
+	f64 frequency = static_cast<f64>( platform_get_tick_frequency() );
+	f64 wallSeconds = static_cast<f64>( wallTicks ) / frequency;
+	f64 gbPerSecond = ( wallSeconds > 0.0 ? static_cast<f64>( total.bytesIn ) / wallSeconds / 1e9 : 0.0 );
+	u64 removed = total.bytesIn - total.bytesOut;
+
+	if ( format == STRIP_STATS_FORMAT_JSON )
+	{
+		printf( "{\n\t\"files\": { \"written\": %" PRIu64 ", \"unchanged\": %" PRIu64 ", \"upToDate\": %" PRIu64 ", \"failed\": %" PRIu64 " },\n", total.written, total.unchanged, total.upToDate, total.failed );
+		printf( "\t\"bytesIn\": %" PRIu64 ",\n\t\"bytesOut\": %" PRIu64 ",\n\t\"bytesRemoved\": %" PRIu64 ",\n", total.bytesIn, total.bytesOut, removed );
+		printf( "\t\"wall\": { \"seconds\": %.6f, \"cycles\": %" PRIu64 " },\n", wallSeconds, wallTicks );
+		printf( "\t\"phases\": {" );
+
+		for ( u32 phase = 0; phase < STRIP_PHASE_COUNT; ++phase )
+			printf( "%s \"%s\": { \"seconds\": %.6f, \"cycles\": %" PRIu64 " }", phase ? "," : "", STRIP_PHASE_NAMES[ phase ], static_cast<f64>( total.ticks[ phase ] ) / frequency, total.ticks[ phase ] );
+
+		printf( " },\n\t\"gbPerSecond\": %.6f,\n\t\"cycleFrequency\": %.0f", gbPerSecond, frequency );
+
+		strip_stats_report_memory( arenas, arenaCount, format );
+
+		bool first = true;
+
+		for ( u32 i = 0; i < threadCount; ++i )
+		{
+			for ( const StripStatsFile *file = threadStats[ i ]->head; file; file = file->next )
+			{
+				printf( "%s\t\t{ \"path\": ", first ? ",\n\t\"perFile\": [\n" : ",\n" );
+				strip_stats_print_json_string( file->path );
+				printf( ", \"result\": \"%s\", \"bytesIn\": %" PRIu64 ", \"bytesOut\": %" PRIu64 ", \"cycles\": {",
+					file->result == STRIP_RESULT_WRITTEN ? "written" : file->result == STRIP_RESULT_UNCHANGED ? "unchanged" : "failed", file->bytesIn, file->bytesOut );
+
+				for ( u32 phase = 0; phase < STRIP_PHASE_COUNT; ++phase )
+					printf( "%s \"%s\": %" PRIu64, phase ? "," : "", STRIP_PHASE_NAMES[ phase ], file->ticks[ phase ] );
+
+				printf( " } }" );
+				first = false;
+			}
+		}
+
+		printf( "%s\n}\n", first ? "" : "\n\t]" );
+		return;
+	}
+
+	for ( u32 i = 0; i < threadCount; ++i )
+	{
+		for ( const StripStatsFile *file = threadStats[ i ]->head; file; file = file->next )
+		{
+			printf( "%12" PRIu64 " -> %12" PRIu64 "  read %12" PRIu64 "  strip %12" PRIu64 "  write %12" PRIu64 " cycles  %s%s\n", file->bytesIn, file->bytesOut,
+				file->ticks[ STRIP_PHASE_READ ], file->ticks[ STRIP_PHASE_STRIP ], file->ticks[ STRIP_PHASE_WRITE ], file->path,
+				file->result == STRIP_RESULT_FAILED ? " ( failed )" : file->result == STRIP_RESULT_UNCHANGED ? " ( unchanged )" : "" );
+		}
+	}
+
+	printf( "Files:      %" PRIu64 " written, %" PRIu64 " unchanged, %" PRIu64 " up to date, %" PRIu64 " failed\n", total.written, total.unchanged, total.upToDate, total.failed );
+	printf( "Bytes in:   %" PRIu64 "\n", total.bytesIn );
+	printf( "Bytes out:  %" PRIu64 "\n", total.bytesOut );
+	printf( "Removed:    %" PRIu64 " ( %.1f%% )\n", removed, total.bytesIn ? 100.0 * static_cast<f64>( removed ) / static_cast<f64>( total.bytesIn ) : 0.0 );
+	printf( "Wall:       %.3f s ( %" PRIu64 " cycles )\n", wallSeconds, wallTicks );
+
+	// Summed over the threads
+	printf( "Read:       %.3f s ( %" PRIu64 " cycles )\n", static_cast<f64>( total.ticks[ STRIP_PHASE_READ ] ) / frequency, total.ticks[ STRIP_PHASE_READ ] );
+	printf( "Strip:      %.3f s ( %" PRIu64 " cycles )\n", static_cast<f64>( total.ticks[ STRIP_PHASE_STRIP ] ) / frequency, total.ticks[ STRIP_PHASE_STRIP ] );
+	printf( "Write:      %.3f s ( %" PRIu64 " cycles )\n", static_cast<f64>( total.ticks[ STRIP_PHASE_WRITE ] ) / frequency, total.ticks[ STRIP_PHASE_WRITE ] );
+
+	printf( "Throughput: %.3f GB/s\n", gbPerSecond );
+
+	strip_stats_report_memory( arenas, arenaCount, format );
+}
+
+// -------------------------------------------------------
+// SPANS
+// -------------------------------------------------------
+
+struct StripSpanWriter
+{
+	StripTarget *target;
+	const u8 *file;
+	u64 size;
+	u64 fileID;				// opened by the first flush that has something to change
+};
+
+static bool strip_file_spans_open( StripSpanWriter *writer )
+{
+	writer->fileID = strip_target_open( writer->target );
+
+	return writer->fileID != INVALID_FILE_INDEX;
+}
+
+static bool strip_file_spans_flush( StripSpanBatch *batch )
+{
+	StripSpanWriter *writer = static_cast<StripSpanWriter *>( batch->user );
+	ManifestHash *hash = writer->target->hash;
+	u64 size = 0;
+
+	for ( u64 i = 0; i < batch->count; ++i )
+	{
+		size += batch->spans[ i ].size;
+
+		if ( hash )
+			manifest_hash_update( hash, batch->spans[ i ].data, batch->spans[ i ].size );
+	}
+
+	if ( writer->fileID == INVALID_FILE_INDEX )
+	{
+		// Kept runs are merged, so one span over the whole file means nothing was dropped
+		if ( batch->count == 1 && batch->spans[ 0 ].data == writer->file && size == writer->size )
+			return true;
+
+		if ( !strip_file_spans_open( writer ) )
+			return false;
+	}
+
+	u64 start = strip_stats_start( STRIP_PHASE_WRITE );
+	bool result = ( write_to_file_spans( writer->fileID, batch->spans, batch->count ) == size );
+	strip_stats_stop( STRIP_PHASE_WRITE, start );
+
+	return result;
+}
+
+// Writes the kept spans of the file straight from the read buffer
+static StripResult strip_file_spans( StripTarget *target, const u8 *file, u64 size, Allocator *allocator )
+{
+	FileSpan *spans = allocator->allocate<FileSpan>( STRIP_SPAN_BATCH_SIZE );
+
+	if ( !spans )
+	{
+		log_warning( "Failed to allocate memory ( %" PRIu64 " spans )", STRIP_SPAN_BATCH_SIZE );
+		return STRIP_RESULT_FAILED;
+	}
+
+	StripSpanWriter writer =
+	{
+		.target = target,
+		.file = file,
+		.size = size,
+		.fileID = INVALID_FILE_INDEX,
+	};
+
+	StripSpanBatch batch =
+	{
+		.spans = spans,
+		.capacity = STRIP_SPAN_BATCH_SIZE,
+		.count = 0,
+		.bytes = 0,
+		.user = &writer,
+		.flush_func = strip_file_spans_flush,
+	};
+
+	// The flushes are timed as writes, so they are taken back out of the strip
+	u64 flushTicks = ( stats ? stats->ticks[ STRIP_PHASE_WRITE ] : 0 );
+	u64 start = strip_stats_start( STRIP_PHASE_STRIP );
+
+	bool result = strip_comments_spans( file, size, &batch );
+
+	if ( stats )
+		start += stats->ticks[ STRIP_PHASE_WRITE ] - flushTicks;
+
+	strip_stats_stop( STRIP_PHASE_STRIP, start );
+
+	start = strip_stats_start( STRIP_PHASE_WRITE );
+
+	// Nothing was kept, so there was never a flush to open it
+	if ( result && writer.fileID == INVALID_FILE_INDEX && batch.bytes != size )
+		result = strip_file_spans_open( &writer );
+
+	bool unchanged = ( writer.fileID == INVALID_FILE_INDEX );
+
+	if ( !unchanged )
+		result = strip_target_close( target, writer.fileID, result );
+
+	strip_stats_stop( STRIP_PHASE_WRITE, start );
+
+	target->written = batch.bytes;
+	allocator->free( spans );
+
+	return ( !result ? STRIP_RESULT_FAILED : unchanged ? STRIP_RESULT_UNCHANGED : STRIP_RESULT_WRITTEN );
+}
+
+// -------------------------------------------------------
+// STREAM
+// -------------------------------------------------------
+
+// Up to the first byte that is dropped the output is the file as it is, so the file is only
+// opened for writing from there. A staged file is written from the start, it replaces the file
+static bool strip_file_stream_write( StripTarget *target, u64 *writeID, u64 offset, const u8 *data, u64 size, bool unchanged )
+{
+	if ( *writeID == INVALID_FILE_INDEX )
+	{
+		if ( unchanged )
+			return true;
+
+		*writeID = open_file( target->filepath, FILE_OPTION_WRITE );
+
+		if ( *writeID == INVALID_FILE_INDEX || !seek_in_file( *writeID, FILE_SEEK_START, offset ) )
+			return false;
+	}
+
+	return size == 0 || write_to_file( *writeID, data, size ) == size;
+}
+
+// Strips the file a chunk at a time, so memory use doesn't depend on its size. The output never
+// overtakes the input, so it is written back over the same file behind the read position
+static StripResult strip_file_stream( StripTarget *target, u64 size, Allocator *allocator )
+{
+	ArenaScope scope( allocator );
+
+	u8 *chunk = allocator->allocate<u8>( STRIP_STREAM_CHUNK_SIZE );
+	u8 *stripped = allocator->allocate<u8>( STRIP_STREAM_CHUNK_SIZE + 1 );
+
+	if ( !chunk || !stripped )
+	{
+		log_warning( "Failed to allocate memory ( %" PRIu64 " bytes )", STRIP_STREAM_CHUNK_SIZE * 2 + 1 );
+		return STRIP_RESULT_FAILED;
+	}
+
+	u64 start = strip_stats_start( STRIP_PHASE_READ );
+	u64 readID = open_file( target->filepath, FILE_OPTION_READ );
+	strip_stats_stop( STRIP_PHASE_READ, start );
+
+	start = strip_stats_start( STRIP_PHASE_WRITE );
+	u64 writeID = ( target->stage && readID != INVALID_FILE_INDEX ? strip_target_open( target ) : INVALID_FILE_INDEX );
+	strip_stats_stop( STRIP_PHASE_WRITE, start );
+
+	bool result = ( readID != INVALID_FILE_INDEX && ( !target->stage || writeID != INVALID_FILE_INDEX ) );
+	StripState state = STRIP_STATE_CODE;
+	u64 remaining = size;
+	u64 written = 0;
+
+	while ( result && remaining > 0 && state != STRIP_STATE_END )
+	{
+		u64 chunkSize = min( remaining, STRIP_STREAM_CHUNK_SIZE );
+
+		start = strip_stats_start( STRIP_PHASE_READ );
+		result = ( read_from_file( readID, chunk, chunkSize ) == chunkSize );
+		strip_stats_stop( STRIP_PHASE_READ, start );
+
+		if ( !result )
+			break;
+
+		remaining -= chunkSize;
+
+		start = strip_stats_start( STRIP_PHASE_STRIP );
+		u64 strippedSize = strip_comments_chunk( chunk, chunkSize, stripped, &state );
+		strip_stats_stop( STRIP_PHASE_STRIP, start );
+
+		// A held '/' isn't output yet, but it hasn't been dropped either
+		bool unchanged = ( written + strippedSize + ( state == STRIP_STATE_CODE_SLASH ? 1 : 0 ) == size - remaining );
+
+		start = strip_stats_start( STRIP_PHASE_WRITE );
+		result = strip_file_stream_write( target, &writeID, written, stripped, strippedSize, unchanged );
+		strip_stats_stop( STRIP_PHASE_WRITE, start );
+
+		if ( target->hash )
+			manifest_hash_update( target->hash, stripped, strippedSize );
+
+		written += strippedSize;
+	}
+
+	start = strip_stats_start( STRIP_PHASE_WRITE );
+
+	if ( result )
+	{
+		u64 strippedSize = strip_comments_chunk_end( state, stripped );
+
+		result = strip_file_stream_write( target, &writeID, written, stripped, strippedSize, written + strippedSize == size );
+
+		if ( target->hash )
+			manifest_hash_update( target->hash, stripped, strippedSize );
+
+		written += strippedSize;
+	}
+
+	// Output only ever drops bytes, so all of them being there means it is the file
+	bool unchanged = ( written == size );
+
+	if ( target->stage )
+	{
+		if ( writeID != INVALID_FILE_INDEX && unchanged )
+			discard_staged_file( target->stage, writeID );
+		else if ( writeID != INVALID_FILE_INDEX )
+			result = strip_target_close( target, writeID, result );
+	}
+	else if ( writeID != INVALID_FILE_INDEX )
+	{
+		// Whatever is left past the output is the tail of the original
+		if ( result )
+			result = truncate_file( writeID, written );
+
+		if ( target->hash )
+			target->timestamp = get_file_last_edit_timestamp( writeID );
+
+		close_file( writeID );
+	}
+
+	if ( readID != INVALID_FILE_INDEX )
+		close_file( readID );
+
+	strip_stats_stop( STRIP_PHASE_WRITE, start );
+
+	target->written = written;
+
+	return ( !result ? STRIP_RESULT_FAILED : unchanged ? STRIP_RESULT_UNCHANGED : STRIP_RESULT_WRITTEN );
+}
+
+// -------------------------------------------------------
+// FILTER
+// -------------------------------------------------------
+
+constexpr const u64 STRIP_FILTER_WRITE_SIZE = MB( 4 );
+
+// stdin to stdout, for the middle of a pipe. Blocks are stripped as they are read with the state
+// carried over, into a buffer that is only written out once the next block might not fit.
+// Memory use is the same however long the input is
+static bool strip_filter( Allocator *allocator )
+{
+	ArenaScope scope( allocator );
+
+	u8 *block = allocator->allocate<u8>( STRIP_STREAM_CHUNK_SIZE );
+	u8 *output = allocator->allocate<u8>( STRIP_FILTER_WRITE_SIZE );
+
+	if ( !block || !output )
+	{
+		log_warning( "Failed to allocate memory ( %" PRIu64 " bytes )", STRIP_STREAM_CHUNK_SIZE + STRIP_FILTER_WRITE_SIZE );
+		return false;
+	}
+
+	u64 inputID = open_standard_input();
+	u64 outputID = open_standard_output();
+
+	StripState state = STRIP_STATE_CODE;
+	u64 used = 0;
+	bool result = true;
+	bool ended = false;
+
+	while ( result && !ended )
+	{
+		u64 start = strip_stats_start( STRIP_PHASE_READ );
+		u64 blockSize = read_from_file_partial( inputID, block, STRIP_STREAM_CHUNK_SIZE );
+		strip_stats_stop( STRIP_PHASE_READ, start );
+
+		ended = ( blockSize < STRIP_STREAM_CHUNK_SIZE );
+
+		if ( ended && file_error( inputID ) )
+		{
+			log_warning( "Failed to read from stdin." );
+			result = false;
+			break;
+		}
+
+		// A null ends the source, but the rest is still read so whatever writes the pipe isn't cut off
+		if ( state == STRIP_STATE_END )
+			continue;
+
+		// A block never strips to more than itself and a held '/'
+		if ( STRIP_FILTER_WRITE_SIZE - used < blockSize + 1 )
+		{
+			start = strip_stats_start( STRIP_PHASE_WRITE );
+			result = ( write_to_file( outputID, output, used ) == used );
+			strip_stats_stop( STRIP_PHASE_WRITE, start );
+
+			used = 0;
+		}
+
+		start = strip_stats_start( STRIP_PHASE_STRIP );
+		used += strip_comments_chunk( block, blockSize, output + used, &state );
+		strip_stats_stop( STRIP_PHASE_STRIP, start );
+	}
+
+	u64 start = strip_stats_start( STRIP_PHASE_WRITE );
+
+	if ( result )
+	{
+		used += strip_comments_chunk_end( state, output + used );
+		result = ( used == 0 || write_to_file( outputID, output, used ) == used );
+	}
+
+	file_flush( outputID );
+	strip_stats_stop( STRIP_PHASE_WRITE, start );
+
+	return result;
+}
+
+// -------------------------------------------------------
+// FILES
+// -------------------------------------------------------
+
+struct StripOptions
+{
+	StripEngine engine;
+	StripInput input;
+	StripOutput output;
+	bool stream;
+	u32 splitThreads;		// threads each file may be split over
+	Manifest *manifest;		// null unless running incrementally
+};
+
+static void strip_file_record( const char *filepath, const StripOptions *options, u64 size, u64 timestamp, u64 hash )
+{
+	if ( !manifest_record( options->manifest, filepath, size, timestamp, hash ) )
+		log_warning( "Failed to add file to the manifest: %s", filepath );
+}
+
+// Only reads the file if the manifest can't tell from its size and timestamp alone
+static bool strip_file_up_to_date( const char *filepath, u64 size, u64 timestamp, const StripOptions *options )
+{
+	const ManifestEntry *entry;
+	ManifestStatus status = manifest_check( options->manifest, filepath, size, timestamp, &entry );
+
+	if ( status == MANIFEST_STATUS_RACY )
+	{
+		MappedFile mapped = {};
+
+		// An empty file can't be mapped, but there is nothing to read either
+		if ( size == 0 )
+		{
+			if ( manifest_hash( nullptr, 0 ) == entry->hash )
+				status = MANIFEST_STATUS_UNCHANGED;
+		}
+		else if ( map_file( filepath, &mapped ) )
+		{
+			if ( manifest_hash( mapped.data, mapped.size ) == entry->hash )
+				status = MANIFEST_STATUS_UNCHANGED;
+
+			unmap_file( &mapped );
+		}
+
+		// Recorded again so the next manifest trusts it without reading it
+		if ( status == MANIFEST_STATUS_UNCHANGED )
+			strip_file_record( filepath, options, size, timestamp, entry->hash );
+	}
+
+	return status == MANIFEST_STATUS_UNCHANGED;
+}
+
+// Reports what became of the file, and remembers it as it is now when running incrementally
+static void strip_file_result( const StripOptions *options, const StripTarget *target, StripResult result, u64 size, u64 timestamp )
+{
+	if ( result == STRIP_RESULT_FAILED )
+	{
+		log_warning( "Failed to write file: %s", target->filepath );
+		strip_stats_file( target->filepath, result, 0, 0 );
+		return;
+	}
+
+	strip_stats_file( target->filepath, result, size, target->written );
+
+	if ( result == STRIP_RESULT_UNCHANGED )
+		log( "Unchanged: %s", target->filepath );
+
+	if ( !options->manifest )
+		return;
+
+	u64 hash = manifest_hash_end( target->hash );
+
+	if ( result == STRIP_RESULT_UNCHANGED )
+		strip_file_record( target->filepath, options, size, timestamp, hash );
+	else
+		strip_file_record( target->filepath, options, target->written, target->timestamp, hash );
+}
+
+// The threads a big file is split over, null unless files may be split. Each thread that strips
+// sets its own, they are started once for the run so a file doesn't pay for creating them
+static thread_local ThreadPool *splitPool = nullptr;
+
+// Strips one file, everything it allocates comes from the arena
+static void strip_file( const char *filepath, const StripOptions *options, MemoryArena *arena, FileStage *stage )
+{
+	// Transient memory only lives for one file, and whatever it took is given back however it returns
+	arena->update();
+	ArenaScope scope( &arena->transient );
+
+	u64 streamSize = file_size( filepath );
+	u64 timestamp = ( options->manifest ? file_last_edit_timestamp( filepath ) : 0 );
+
+	// Skipped without being opened when it is just as the last run left it
+	if ( options->manifest && strip_file_up_to_date( filepath, streamSize, timestamp, options ) )
+	{
+		log( "Up to date: %s", filepath );
+		strip_stats_up_to_date();
+		return;
+	}
+
+	log( "Processing: %s", filepath );
+
+	ManifestHash hash;
+	manifest_hash_begin( &hash );
+
+	StripTarget target =
+	{
+		.filepath = filepath,
+		.stage = stage,
+		.hash = ( options->manifest ? &hash : nullptr ),
+		.written = 0,
+		.timestamp = 0,
+	};
+
+	// Files that won't fit in the transient arena are streamed instead
+	u64 required = ( streamSize + 1 ) * ( options->input == STRIP_INPUT_READ && options->output == STRIP_OUTPUT_COPY ? 2 : 1 ) + KB( 64 );
+
+	if ( options->stream || required > arena->transient.available )
+	{
+		log( "Streaming file: %s", filepath );
+
+		StripResult result = strip_file_stream( &target, streamSize, &arena->transient );
+		strip_file_result( options, &target, result, streamSize, timestamp );
+
+		return;
+	}
+
+	MappedFile mapped = {};
+	u8 *file = nullptr;
+	u64 size = 0;
+	u64 start = strip_stats_start( STRIP_PHASE_READ );
+
+	if ( options->input == STRIP_INPUT_MAP && map_file( filepath, &mapped ) )
+	{
+		file = mapped.data;
+		size = mapped.size;
+	}
+	else
+	{
+		u64 fileSize;
+		file = read_file( filepath, &fileSize, true, &arena->transient );
+
+		if ( !file )
+		{
+			log_warning( "Failed to read file: %s", filepath );
+			strip_stats_stop( STRIP_PHASE_READ, start );
+			strip_stats_file( filepath, STRIP_RESULT_FAILED, 0, 0 );
+			return;
+		}
+
+		// fileSize includes the null terminator
+		size = fileSize - 1;
+	}
+
+	strip_stats_stop( STRIP_PHASE_READ, start );
+
+	if ( options->output == STRIP_OUTPUT_SPANS )
+	{
+		StripResult result = strip_file_spans( &target, file, size, &arena->transient );
+		strip_file_result( options, &target, result, size, timestamp );
+		return;
+	}
+
+	u8 *newFile = file;
+
+	if ( options->output == STRIP_OUTPUT_COPY )
+	{
+		newFile = arena->transient.allocate<u8>( size + 1 );
+
+		if ( !newFile )
+		{
+			log_warning( "Failed to allocate memory ( %" PRIu64 " bytes )", size + 1 );
+			strip_stats_file( filepath, STRIP_RESULT_FAILED, 0, 0 );
+
+			if ( mapped.data )
+				unmap_file( &mapped );
+			return;
+		}
+	}
+
+	// Big files are split over the threads that have no file of their own
+	u32 chunkCount = ( splitPool ? static_cast<u32>( min<u64>( options->splitThreads, size / STRIP_PARALLEL_MIN_CHUNK_SIZE ) ) : 1 );
+
+	start = strip_stats_start( STRIP_PHASE_STRIP );
+
+	u64 newFileSize = ( chunkCount > 1
+		? strip_comments_parallel( file, size, newFile, chunkCount, splitPool, &arena->transient )
+		: strip_comments( options->engine, file, size, newFile ) );
+
+	strip_stats_stop( STRIP_PHASE_STRIP, start );
+
+	// Unmapped before the file is truncated by the write
+	if ( mapped.data )
+	{
+		unmap_file( &mapped );
+		file = nullptr;
+	}
+
+	// Left alone when nothing was stripped, so its timestamp doesn't make anything downstream rebuild
+	StripResult result = STRIP_RESULT_UNCHANGED;
+
+	if ( newFileSize != size )
+	{
+		log( "Writing file: %s", filepath );
+
+		start = strip_stats_start( STRIP_PHASE_WRITE );
+
+		u64 fileID = strip_target_open( &target );
+		bool written = ( fileID != INVALID_FILE_INDEX && write_to_file( fileID, newFile, newFileSize ) == newFileSize );
+
+		if ( fileID != INVALID_FILE_INDEX )
+			written = strip_target_close( &target, fileID, written );
+
+		result = ( written ? STRIP_RESULT_WRITTEN : STRIP_RESULT_FAILED );
+
+		strip_stats_stop( STRIP_PHASE_WRITE, start );
+	}
+
+	if ( target.hash )
+		manifest_hash_update( target.hash, newFile, newFileSize );
+
+	target.written = newFileSize;
+	strip_file_result( options, &target, result, size, timestamp );
+}
+
+// -------------------------------------------------------
+// BATCHES
+// -------------------------------------------------------
+
+// Room for a batch of small files, the files of a batch that don't fit wait for the next pass
+constexpr const u64 STRIP_BATCH_BUFFER_SIZE = MB( 4 );
+
+using StripBatchState = u8;
+enum STRIP_BATCH_STATE : StripBatchState
+{
+	STRIP_BATCH_STATE_RING,				// read, stripped and written through the ring
+	STRIP_BATCH_STATE_FILE,				// too big or the ring failed it, stripped on its own afterwards
+	STRIP_BATCH_STATE_DONE,
+};
+
+// Files are gathered on each worker and stripped a batch at a time through its ring
+struct StripBatch
+{
+	FileRing ring;
+	u64 count;
+	RingFile files[ FILE_RING_BATCH_SIZE ];
+	StripBatchState states[ FILE_RING_BATCH_SIZE ];
+	ManifestHash hashes[ FILE_RING_BATCH_SIZE ];
+	u64 sizes[ FILE_RING_BATCH_SIZE ];							// as read, a file's size becomes what is written
+	u64 ticks[ FILE_RING_BATCH_SIZE ][ STRIP_PHASE_COUNT ];		// only with --stats
+	char paths[ FILE_RING_BATCH_SIZE ][ MAX_FILEPATH ];
+};
+
+// Strips a file that has been read into the ring's buffer. It is left with data set only if
+// it still has to be written
+static void strip_batch_file( StripBatch *batch, u64 index, const StripOptions *options, FileStage *stage )
+{
+	RingFile *file = &batch->files[ index ];
+	ManifestHash *hash = &batch->hashes[ index ];
+	u64 size = file->size;
+
+	log( "Processing: %s", file->path );
+
+	u64 start = strip_stats_start( STRIP_PHASE_STRIP );
+
+	file->data[ size ] = '\0';
+	u64 newFileSize = strip_comments( options->engine, file->data, size, file->data );
+
+	strip_stats_stop( STRIP_PHASE_STRIP, start );
+
+	manifest_hash_begin( hash );
+
+	StripTarget target =
+	{
+		.filepath = file->path,
+		.stage = stage,
+		.hash = ( options->manifest ? hash : nullptr ),
+		.written = newFileSize,
+		.timestamp = 0,
+	};
+
+	if ( target.hash )
+		manifest_hash_update( target.hash, file->data, newFileSize );
+
+	if ( newFileSize == size )
+	{
+		strip_file_result( options, &target, STRIP_RESULT_UNCHANGED, size, file->timestamp );
+		file->data = nullptr;
+		return;
+	}
+
+	log( "Writing file: %s", file->path );
+
+	// Staged files are written one at a time, they are synced and published a stage at a time
+	if ( stage )
+	{
+		start = strip_stats_start( STRIP_PHASE_WRITE );
+
+		u64 fileID = strip_target_open( &target );
+		bool written = ( fileID != INVALID_FILE_INDEX && write_to_file( fileID, file->data, newFileSize ) == newFileSize );
+
+		if ( fileID != INVALID_FILE_INDEX )
+			written = strip_target_close( &target, fileID, written );
+
+		strip_stats_stop( STRIP_PHASE_WRITE, start );
+		strip_file_result( options, &target, written ? STRIP_RESULT_WRITTEN : STRIP_RESULT_FAILED, size, file->timestamp );
+		file->data = nullptr;
+		return;
+	}
+
+	// Its time is put aside while the rest of the batch is stripped
+	memset( batch->ticks[ index ], 0, sizeof( batch->ticks[ index ] ) );
+	strip_stats_take( batch->ticks[ index ] );
+
+	batch->sizes[ index ] = size;
+	file->size = newFileSize;
+}
+
+// Strips every file in the batch. Each pass reads as many as fit in the buffer with one submit
+// and writes back the ones that changed with another
+static void strip_batch_flush( StripBatch *batch, const StripOptions *options, MemoryArena *arena, FileStage *stage )
+{
+	FileRing *ring = &batch->ring;
+	RingFile *files = batch->files;
+	u64 count = batch->count;
+
+	batch->count = 0;
+
+	if ( count == 0 )
+		return;
+
+	u64 start = strip_stats_start( STRIP_PHASE_READ );
+	bool result = file_ring_stat( ring, files, count );
+	strip_stats_stop_shared( STRIP_PHASE_READ, start );
+
+	// An empty file has nothing to read, the usual path sorts it out
+	for ( u64 i = 0; i < count; ++i )
+	{
+		RingFile *file = &files[ i ];
+		batch->states[ i ] = STRIP_BATCH_STATE_FILE;
+
+		if ( file->error || file->size == 0 || file->size + 1 > ring->bufferSize )
+			continue;
+
+		if ( options->manifest && strip_file_up_to_date( file->path, file->size, file->timestamp, options ) )
+		{
+			log( "Up to date: %s", file->path );
+			strip_stats_up_to_date();
+			batch->states[ i ] = STRIP_BATCH_STATE_DONE;
+			continue;
+		}
+
+		batch->states[ i ] = STRIP_BATCH_STATE_RING;
+	}
+
+	for ( u64 begin = 0; begin < count && result; )
+	{
+		u64 used = 0;
+		u64 end = begin;
+
+		for ( ; end < count; ++end )
+		{
+			RingFile *file = &files[ end ];
+			file->data = nullptr;
+
+			if ( batch->states[ end ] != STRIP_BATCH_STATE_RING )
+				continue;
+
+			// Kept 64 byte aligned for the engines
+			u64 required = ( file->size + 1 + 63 ) & ~63ull;
+
+			if ( used + required > ring->bufferSize )
+				break;
+
+			file->data = ring->buffer + used;
+			used += required;
+		}
+
+		RingFile *pass = &files[ begin ];
+		u64 passCount = end - begin;
+
+		start = strip_stats_start( STRIP_PHASE_READ );
+		result = file_ring_read( ring, pass, passCount );
+		strip_stats_stop_shared( STRIP_PHASE_READ, start );
+
+		for ( u64 i = begin; i < end && result; ++i )
+		{
+			if ( !files[ i ].data )
+				continue;
+
+			// Whatever went wrong, the usual path gets to try it and report it
+			if ( files[ i ].error )
+			{
+				files[ i ].data = nullptr;
+				batch->states[ i ] = STRIP_BATCH_STATE_FILE;
+				continue;
+			}
+
+			batch->states[ i ] = STRIP_BATCH_STATE_DONE;
+			strip_batch_file( batch, i, options, stage );
+		}
+
+		start = strip_stats_start( STRIP_PHASE_WRITE );
+
+		if ( result )
+			result = file_ring_write( ring, pass, passCount, options->manifest != nullptr );
+
+		strip_stats_stop_shared( STRIP_PHASE_WRITE, start );
+
+		for ( u64 i = begin; i < end; ++i )
+		{
+			RingFile *file = &files[ i ];
+
+			if ( !file->data || batch->states[ i ] != STRIP_BATCH_STATE_DONE )
+				continue;
+
+			StripTarget target =
+			{
+				.filepath = file->path,
+				.stage = nullptr,
+				.hash = ( options->manifest ? &batch->hashes[ i ] : nullptr ),
+				.written = file->size,
+				.timestamp = file->timestamp,
+			};
+
+			strip_stats_give( batch->ticks[ i ] );
+			strip_file_result( options, &target, file->error ? STRIP_RESULT_FAILED : STRIP_RESULT_WRITTEN, batch->sizes[ i ], file->timestamp );
+		}
+
+		begin = end;
+	}
+
+	// A ring that failed once isn't used again, every file from here goes the usual way
+	if ( !result )
+	{
+		log_warning( "Batched I/O failed, reading files with stdio." );
+		file_ring_free( ring );
+
+		for ( u64 i = 0; i < count; ++i )
+		{
+			if ( batch->states[ i ] == STRIP_BATCH_STATE_RING )
+				batch->states[ i ] = STRIP_BATCH_STATE_FILE;
+		}
+	}
+
+	for ( u64 i = 0; i < count; ++i )
+	{
+		if ( batch->states[ i ] == STRIP_BATCH_STATE_FILE )
+			strip_file( files[ i ].path, options, arena, stage );
+	}
+}
+
+// The path may not outlive the call, so the batch keeps its own copy
+static void strip_batch_add( StripBatch *batch, const char *filepath, const StripOptions *options, MemoryArena *arena, FileStage *stage )
+{
+	u64 bytes = string_utf8_bytes( filepath );
+
+	if ( batch->ring.fd < 0 || bytes > MAX_FILEPATH )
+	{
+		strip_file( filepath, options, arena, stage );
+		return;
+	}
+
+	memcpy( batch->paths[ batch->count ], filepath, bytes );
+	batch->files[ batch->count ].path = batch->paths[ batch->count ];
+	batch->count += 1;
+
+	if ( batch->count == FILE_RING_BATCH_SIZE )
+		strip_batch_flush( batch, options, arena, stage );
+}
+
+// Started once and used by every file a worker splits. If the threads can't be started up front,
+// each split starts its own as it used to
+static ThreadPool *strip_split_pool_create( Allocator *allocator, u32 threadCount )
+{
+	if ( threadCount <= 1 )
+		return nullptr;
+
+	ThreadPool *pool = allocator->allocate<ThreadPool>();
+
+	if ( !pool )
+		return nullptr;
+
+	if ( !thread_pool_start( pool, threadCount ) )
+		log_warning( "Failed to start the split threads, each split file starts its own." );
+
+	return pool;
+}
+
+static void strip_split_pool_free( ThreadPool *pool )
+{
+	if ( pool )
+		thread_pool_stop( pool );
+}
+
+struct StripJob
+{
+	const StripOptions *options;
+	char **files;
+	MemoryArena *arenas[ THREAD_MAX_WORKERS ];
+	FileStage *stages[ THREAD_MAX_WORKERS ];		// null unless writes are durable
+	StripBatch *batches[ THREAD_MAX_WORKERS ];		// null unless files are read in batches
+	StripStats *stats[ THREAD_MAX_WORKERS ];		// null unless --stats
+	ThreadPool *splitPools[ THREAD_MAX_WORKERS ];	// null unless files may be split
+};
+
+static void strip_job_file( StripJob *job, const char *filepath, u32 worker )
+{
+	// Anything that reaches for the global memory pointer gets this worker's arena
+	memory = job->arenas[ worker ];
+	stats = job->stats[ worker ];
+	splitPool = job->splitPools[ worker ];
+
+	if ( job->batches[ worker ] )
+		strip_batch_add( job->batches[ worker ], filepath, job->options, memory, job->stages[ worker ] );
+	else
+		strip_file( filepath, job->options, memory, job->stages[ worker ] );
+}
+
+static void strip_job_task( u64 task, u32 worker, void *user )
+{
+	StripJob *job = static_cast<StripJob *>( user );
+
+	strip_job_file( job, job->files[ task ], worker );
+}
+
+// Whatever each worker has gathered but not yet stripped. The task is the batch, whichever worker runs it
+static void strip_job_flush_task( u64 task, u32 worker, void *user )
+{
+	StripJob *job = static_cast<StripJob *>( user );
+
+	memory = job->arenas[ worker ];
+	stats = job->stats[ worker ];
+	splitPool = job->splitPools[ worker ];
+
+	strip_batch_flush( job->batches[ task ], job->options, memory, job->stages[ worker ] );
+}
+
+// Only C family sources are picked up when walking a tree
+constexpr const char *STRIP_SOURCE_EXTENSIONS[] =
+{
+	"c", "h", "cc", "hh", "cpp", "hpp", "cxx", "hxx", "inl",
+};
+
+static bool strip_walk_filter( const char *name )
+{
+	for ( const char *ext : STRIP_SOURCE_EXTENSIONS )
+	{
+		if ( string_utf8_has_ext( name, ext ) )
+			return true;
+	}
+
+	return false;
+}
+
+static void strip_walk_file( const char *path, u32 worker, void *user )
+{
+	strip_job_file( static_cast<StripJob *>( user ), path, worker );
+}
+
+// -------------------------------------------------------
+// PIPELINE
+// -------------------------------------------------------
+
+// Bytes that may be read but not yet written back, the reader waits on the writer past this
+constexpr const u64 STRIP_PIPELINE_BUDGET = MB( 8 );
+
+// A file on its way through the pipeline. It sits in the budget just ahead of its contents
+struct StripPipelineFile
+{
+	u64 start;				// where in the stream of budget it begins, counting any skipped at the wrap
+	u64 span;				// bytes of budget it takes, counting any skipped at the wrap
+	u8 *data;				// null if it was too big for the budget, it is stripped on its own
+	u64 size;
+	u64 newFileSize;
+	u64 timestamp;
+	ManifestHash hash;
+	u64 ticks[ STRIP_PHASE_COUNT ];		// only with --stats
+	char path[ 1 ];			// allocated to fit
+};
+
+// Files are read on one thread, stripped on the calling thread and written on another, so the
+// disk and the processor are kept busy at once. The budget is handed out and given back in the
+// order the files are read, so it is used as a ring
+struct StripPipeline
+{
+	const StripOptions *options;
+	MemoryArena *arena;						// the stripper's
+	FileStage *stage;						// only ever used by one stage at a time
+	char **files;
+	u64 fileCount;
+	const char **roots;
+	u64 rootCount;
+
+	u8 *budget;
+	u64 budgetSize;
+	u64 allocated;								// only the reader moves it
+	alignas( 64 ) std::atomic<u64> released = 0;	// the writer moves it, or the stripper once nothing is ahead of it
+
+	ThreadRing read;						// reader to stripper
+	ThreadRing stripped;					// stripper to writer
+
+	StripStats *readerStats;				// null unless --stats, the stripper has the calling thread's
+	StripStats *writerStats;
+	ThreadPool *splitPool;					// the stripper's, null unless files may be split
+};
+
+static StripPipelineFile *strip_pipeline_allocate( StripPipeline *pipeline, u64 bytes )
+{
+	// A file is never split over the end of the budget, whatever is left there is skipped
+	u64 offset = pipeline->allocated % pipeline->budgetSize;
+	u64 skipped = ( offset + bytes > pipeline->budgetSize ? pipeline->budgetSize - offset : 0 );
+	u64 span = skipped + bytes;
+	u64 released = pipeline->released.load( std::memory_order_acquire );
+
+	while ( pipeline->allocated + span - released > pipeline->budgetSize )
+	{
+		pipeline->released.wait( released, std::memory_order_acquire );
+		released = pipeline->released.load( std::memory_order_acquire );
+	}
+
+	StripPipelineFile *file = reinterpret_cast<StripPipelineFile *>( pipeline->budget + ( skipped ? 0 : offset ) );
+	file->start = pipeline->allocated;
+	file->span = span;
+
+	pipeline->allocated += span;
+
+	return file;
+}
+
+static void strip_pipeline_release( StripPipeline *pipeline, StripPipelineFile *file )
+{
+	pipeline->released.fetch_add( file->span, std::memory_order_release );
+	pipeline->released.notify_all();
+}
+
+static void strip_pipeline_read( StripPipeline *pipeline, const char *filepath )
+{
+	const StripOptions *options = pipeline->options;
+	u64 size = file_size( filepath );
+	u64 timestamp = ( options->manifest ? file_last_edit_timestamp( filepath ) : 0 );
+
+	if ( options->manifest && strip_file_up_to_date( filepath, size, timestamp, options ) )
+	{
+		log( "Up to date: %s", filepath );
+		strip_stats_up_to_date();
+		return;
+	}
+
+	u64 pathBytes = string_utf8_bytes( filepath );
+	u64 headerBytes = ( offsetof( StripPipelineFile, path ) + pathBytes + 63 ) & ~63ull;
+	u64 dataBytes = ( size + 1 + 63 ) & ~63ull;
+
+	// At most half the budget, so once everything ahead of it is written there is always room
+	// wherever the wrap falls. An empty file has nothing to read, the usual path sorts it out
+	bool whole = ( size == 0 || headerBytes + dataBytes > pipeline->budgetSize / 2 );
+
+	StripPipelineFile *file = strip_pipeline_allocate( pipeline, headerBytes + ( whole ? 0 : dataBytes ) );
+	memcpy( file->path, filepath, pathBytes );
+	file->data = ( whole ? nullptr : reinterpret_cast<u8 *>( file ) + headerBytes );
+	file->size = size;
+	file->newFileSize = 0;
+	file->timestamp = timestamp;
+	memset( file->ticks, 0, sizeof( file->ticks ) );
+
+	if ( file->data )
+	{
+		u64 start = strip_stats_start( STRIP_PHASE_READ );
+		u64 fileID = open_file( filepath, FILE_OPTION_READ );
+		bool result = ( fileID != INVALID_FILE_INDEX && read_from_file( fileID, file->data, size ) == size );
+
+		if ( fileID != INVALID_FILE_INDEX )
+			close_file( fileID );
+
+		strip_stats_stop( STRIP_PHASE_READ, start );
+
+		// Nothing has been allocated since, so it can just be handed back
+		if ( !result )
+		{
+			log_warning( "Failed to read file: %s", filepath );
+			strip_stats_file( filepath, STRIP_RESULT_FAILED, 0, 0 );
+			pipeline->allocated -= file->span;
+			return;
+		}
+
+		file->data[ size ] = '\0';
+		strip_stats_take( file->ticks );
+	}
+
+	thread_ring_push( &pipeline->read, reinterpret_cast<u64>( file ) );
+}
+
+static void strip_pipeline_walk_file( const char *path, u32 worker, void *user )
+{
+	(void)worker;
+
+	strip_pipeline_read( static_cast<StripPipeline *>( user ), path );
+}
+
+static void strip_pipeline_reader( void *user )
+{
+	StripPipeline *pipeline = static_cast<StripPipeline *>( user );
+	stats = pipeline->readerStats;
+
+	for ( u64 i = 0; i < pipeline->fileCount; ++i )
+		strip_pipeline_read( pipeline, pipeline->files[ i ] );
+
+	if ( pipeline->rootCount > 0 && !walk_directories( pipeline->roots, pipeline->rootCount, 1, strip_walk_filter, strip_pipeline_walk_file, pipeline ) )
+		log_warning( "Failed to walk every directory." );
+
+	thread_ring_push( &pipeline->read, 0 );
+}
+
+static void strip_pipeline_writer( void *user )
+{
+	StripPipeline *pipeline = static_cast<StripPipeline *>( user );
+	const StripOptions *options = pipeline->options;
+
+	stats = pipeline->writerStats;
+
+	while ( StripPipelineFile *file = reinterpret_cast<StripPipelineFile *>( thread_ring_pop( &pipeline->stripped ) ) )
+	{
+		StripTarget target =
+		{
+			.filepath = file->path,
+			.stage = pipeline->stage,
+			.hash = ( options->manifest ? &file->hash : nullptr ),
+			.written = file->newFileSize,
+			.timestamp = 0,
+		};
+
+		StripResult result = STRIP_RESULT_UNCHANGED;
+
+		if ( file->newFileSize != file->size )
+		{
+			log( "Writing file: %s", file->path );
+
+			u64 start = strip_stats_start( STRIP_PHASE_WRITE );
+
+			u64 fileID = strip_target_open( &target );
+			bool written = ( fileID != INVALID_FILE_INDEX && write_to_file( fileID, file->data, file->newFileSize ) == file->newFileSize );
+
+			if ( fileID != INVALID_FILE_INDEX )
+				written = strip_target_close( &target, fileID, written );
+
+			result = ( written ? STRIP_RESULT_WRITTEN : STRIP_RESULT_FAILED );
+
+			strip_stats_stop( STRIP_PHASE_WRITE, start );
+		}
+
+		strip_stats_give( file->ticks );
+		strip_file_result( options, &target, result, file->size, file->timestamp );
+		strip_pipeline_release( pipeline, file );
+	}
+}
+
+// The stripping stage, on the calling thread
+static void strip_pipeline_strip( StripPipeline *pipeline )
+{
+	const StripOptions *options = pipeline->options;
+	MemoryArena *arena = pipeline->arena;
+	splitPool = pipeline->splitPool;
+
+	while ( StripPipelineFile *file = reinterpret_cast<StripPipelineFile *>( thread_ring_pop( &pipeline->read ) ) )
+	{
+		// Stripped with its own reads and writes once the writer has caught up, so the stage
+		// is never used by two threads at once
+		if ( !file->data )
+		{
+			u64 released = pipeline->released.load( std::memory_order_acquire );
+
+			while ( released != file->start )
+			{
+				pipeline->released.wait( released, std::memory_order_acquire );
+				released = pipeline->released.load( std::memory_order_acquire );
+			}
+
+			strip_file( file->path, options, arena, pipeline->stage );
+			strip_pipeline_release( pipeline, file );
+			continue;
+		}
+
+		arena->update();
+
+		log( "Processing: %s", file->path );
+
+		u32 chunkCount = ( splitPool ? static_cast<u32>( min<u64>( options->splitThreads, file->size / STRIP_PARALLEL_MIN_CHUNK_SIZE ) ) : 1 );
+		u64 start = strip_stats_start( STRIP_PHASE_STRIP );
+
+		file->newFileSize = ( chunkCount > 1
+			? strip_comments_parallel( file->data, file->size, file->data, chunkCount, splitPool, &arena->transient )
+			: strip_comments( options->engine, file->data, file->size, file->data ) );
+
+		strip_stats_stop( STRIP_PHASE_STRIP, start );
+		strip_stats_take( file->ticks );
+
+		manifest_hash_begin( &file->hash );
+
+		if ( options->manifest )
+			manifest_hash_update( &file->hash, file->data, file->newFileSize );
+
+		thread_ring_push( &pipeline->stripped, reinterpret_cast<u64>( file ) );
+	}
+
+	thread_ring_push( &pipeline->stripped, 0 );
+}
+
+// False if the threads couldn't be started, nothing has been stripped then
+static bool strip_pipeline_run( StripPipeline *pipeline )
+{
+	u64 writer = platform_thread_create( strip_pipeline_writer, pipeline );
+
+	if ( !writer )
+		return false;
+
+	u64 reader = platform_thread_create( strip_pipeline_reader, pipeline );
+
+	if ( !reader )
+	{
+		thread_ring_push( &pipeline->stripped, 0 );
+		platform_thread_join( writer );
+		return false;
+	}
+
+	strip_pipeline_strip( pipeline );
+
+	platform_thread_join( reader );
+	platform_thread_join( writer );
+
+	return true;
+}
+
 // -------------------------------------------------------
 // ENTRY
 // -------------------------------------------------------
@@ -20,11 +1563,20 @@ int main( int argc, char *argv[] )
 		return ERROR_CODE_NO_INPUT_FILES;
 	}
 
+	// A filter's output is stdout, so nothing else can be printed there from the very start
+	for ( i32 argEntry = 1; argEntry < argc; ++argEntry )
+	{
+		if ( string_utf8_compare( argv[ argEntry ], "-" ) )
+			messageFile = stderr;
+	}
+
 	{
 		// -- memory ---------------------------------------------
 		MemoryArena memoryArena = memory_default();
 
-		if ( !memoryArena.init( KB( 1 ), MB( 32 ), KB( 0 ), true ) )
+		// Reserved up front and committed as it is used, so a small run only touches what it needs.
+		// If the address space can't be reserved, fall back to a fixed block
+		if ( !memoryArena.init_virtual( MB( 16 ), GB( 64ull ), MB( 64 ), MB( 64 ) ) && !memoryArena.init( KB( 1 ), MB( 32 ), KB( 0 ), true ) )
 		{
 			log_warning( "Failed to initialise memory arena." );
 			return ERROR_CODE_FAILED_TO_INITIALISE_MEMORY_ARENA;
@@ -57,98 +1609,502 @@ int main( int argc, char *argv[] )
 		#endif
 	}
 
-	for ( i32 argEntry = 0, count = argc - 1; argEntry < count; ++argEntry )
+	// -- arguments ---------------------------------------------
+	StripEngine engine = strip_engine_default();
+	StripInput input = STRIP_INPUT_MAP;
+	StripOutput output = STRIP_OUTPUT_IN_PLACE;
+	bool outputSet = false;
+	bool stream = false;
+	bool durable = false;
+	bool pipeline = false;
+	bool statsEnabled = false;
+	bool statsFiles = false;
+	bool hugePages = false;
+	bool filter = false;
+	StripStatsFormat statsFormat = STRIP_STATS_FORMAT_TEXT;
+	const char *manifestPath = nullptr;
+	const char *tracePath = nullptr;
+	u32 jobs = 1;
+	i32 fileCount = 0;
+	i32 rootCount = 0;
+
+	// Directories given with -r, there can't be more of them than arguments
+	const char **roots = memory->permanent.allocate<const char *>( argc );
+
+	if ( !roots )
 	{
-		const char *filepath = argv[ argEntry + 1 ];
+		log_warning( "Failed to allocate memory ( %" PRIu64 " bytes )", sizeof( const char * ) * argc );
+		return ERROR_CODE_FAILED_TO_INITIALISE_MEMORY_ARENA;
+	}
 
-		log( "Processing: %s", filepath );
+	for ( i32 argEntry = 1; argEntry < argc; ++argEntry )
+	{
+		const char *arg = argv[ argEntry ];
 
-		u64 fileSize;
-		u8 *file = read_file( filepath, &fileSize, true, &memory->transient );
-		u8 *newFile = memory->transient.allocate<u8>( fileSize, true );
-		u8 *src = file;
-		u8 *dst = newFile;
-		char l = '\0';
-		char c = *src++;
-		bool inComment = false;
-		bool blockComment = false;
-		bool inStringLiteral = false;
-		char stringLiteralOpener = '\0';
-
-		while ( c != '\0' )
-		{
-			if ( c == '/' && ( *src == '/' || *src == '*' ) && !inComment && !inStringLiteral )
-			{
-				inComment = true;
-				blockComment = ( *src == '*' );
-				src += 1;
-			}
-			else if ( c == '\n' && !blockComment )
-			{
-				inComment = false;
-			}
-			else if ( ( c == '*' && *src == '/' ) && blockComment )
-			{
-				inComment = false;
-				blockComment = false;
-				src += 1;
-			}
-			else if ( !inComment )
-			{
-				if ( l != '\\' && ( c == '"' || c == '\'' ) )
-				{
-					if ( !inStringLiteral )
-					{
-						if ( c == '"' )
-						{
-							inStringLiteral = true;
-							stringLiteralOpener = '"';
-						}
-						else if ( c == '\'' )
-						{
-							inStringLiteral = true;
-							stringLiteralOpener = '\'';
-						}
-					}
-					else
-					{
-						if ( c == '"' && stringLiteralOpener == '"' )
-						{
-							inStringLiteral = false;
-							stringLiteralOpener = '\0';
-						}
-						else if ( c == '\'' && stringLiteralOpener == '\'' )
-						{
-							inStringLiteral = false;
-							stringLiteralOpener = '\0';
-						}
-					}
-				}
-
-				*dst++ = c;
-			}
-
-			l = c;
-			c = *src++;
+		if ( string_utf8_compare( arg, "--engine" ) )
+		{
+			if ( argEntry + 1 >= argc )
+			{
+				log_warning( "Missing engine name after --engine." );
+				return ERROR_CODE_INVALID_ARGUMENTS;
+			}
+
+			engine = strip_engine_from_name( argv[ ++argEntry ] );
+
+			if ( engine == STRIP_ENGINE_COUNT )
+			{
+				log_warning( "Unknown engine: %s", argv[ argEntry ] );
+				return ERROR_CODE_INVALID_ARGUMENTS;
+			}
+
+			if ( engine == STRIP_ENGINE_AVX2 && !platform_cpu_supports_avx2() )
+			{
+				log_warning( "AVX2 not supported, using the skip engine." );
+				engine = STRIP_ENGINE_SKIP;
+			}
 		}
+		else if ( string_utf8_compare( arg, "--input" ) )
+		{
+			if ( argEntry + 1 >= argc )
+			{
+				log_warning( "Missing input mode after --input." );
+				return ERROR_CODE_INVALID_ARGUMENTS;
+			}
 
-		log( "Writing file: %s", filepath );
+			input = strip_input_from_name( argv[ ++argEntry ] );
+
+			if ( input == STRIP_INPUT_COUNT )
+			{
+				log_warning( "Unknown input mode: %s", argv[ argEntry ] );
+				return ERROR_CODE_INVALID_ARGUMENTS;
+			}
+		}
+		else if ( string_utf8_compare( arg, "--output" ) )
+		{
+			if ( argEntry + 1 >= argc )
+			{
+				log_warning( "Missing output mode after --output." );
+				return ERROR_CODE_INVALID_ARGUMENTS;
+			}
+
+			output = strip_output_from_name( argv[ ++argEntry ] );
+			outputSet = true;
+
+			if ( output == STRIP_OUTPUT_COUNT )
+			{
+				log_warning( "Unknown output mode: %s", argv[ argEntry ] );
+				return ERROR_CODE_INVALID_ARGUMENTS;
+			}
+		}
+		else if ( string_utf8_compare( arg, "-j" ) )
+		{
+			if ( argEntry + 1 >= argc )
+			{
+				log_warning( "Missing thread count after -j." );
+				return ERROR_CODE_INVALID_ARGUMENTS;
+			}
+
+			const char *end;
+			jobs = convert_to_u32( argv[ ++argEntry ], &end );
+
+			if ( end == argv[ argEntry ] || *end != '\0' )
+			{
+				log_warning( "Invalid thread count: %s", argv[ argEntry ] );
+				return ERROR_CODE_INVALID_ARGUMENTS;
+			}
+
+			// -j 0 uses every processor
+			if ( jobs == 0 )
+				jobs = platform_processor_count();
+		}
+		else if ( string_utf8_compare( arg, "--stream" ) )
+		{
+			stream = true;
+		}
+		else if ( string_utf8_compare( arg, "--durable" ) )
+		{
+			durable = true;
+		}
+		else if ( string_utf8_compare( arg, "--pipeline" ) )
+		{
+			pipeline = true;
+		}
+		else if ( string_utf8_compare( arg, "--stats" ) )
+		{
+			statsEnabled = true;
+		}
+		else if ( string_utf8_compare( arg, "--stats-json" ) )
+		{
+			statsEnabled = true;
+			statsFormat = STRIP_STATS_FORMAT_JSON;
+		}
+		else if ( string_utf8_compare( arg, "--stats-files" ) )
+		{
+			statsEnabled = true;
+			statsFiles = true;
+		}
+		else if ( string_utf8_compare( arg, "--huge-pages" ) )
+		{
+			hugePages = true;
+		}
+		else if ( string_utf8_compare( arg, "--trace" ) )
+		{
+			if ( argEntry + 1 >= argc )
+			{
+				log_warning( "Missing trace path after --trace." );
+				return ERROR_CODE_INVALID_ARGUMENTS;
+			}
+
+			tracePath = argv[ ++argEntry ];
+		}
+		else if ( string_utf8_compare( arg, "--manifest" ) )
+		{
+			if ( argEntry + 1 >= argc )
+			{
+				log_warning( "Missing manifest path after --manifest." );
+				return ERROR_CODE_INVALID_ARGUMENTS;
+			}
+
+			manifestPath = argv[ ++argEntry ];
+		}
+		else if ( string_utf8_compare( arg, "-r" ) )
+		{
+			if ( argEntry + 1 >= argc )
+			{
+				log_warning( "Missing directory after -r." );
+				return ERROR_CODE_INVALID_ARGUMENTS;
+			}
+
+			roots[ rootCount++ ] = argv[ ++argEntry ];
+		}
+		else if ( string_utf8_compare( arg, "-" ) )
+		{
+			filter = true;
+		}
+		else
+		{
+			// Compact the files to the front of argv
+			argv[ fileCount++ ] = argv[ argEntry ];
+		}
+	}
+
+	if ( filter && ( fileCount > 0 || rootCount > 0 ) )
+	{
+		log_warning( "- can't be mixed with other files." );
+		return ERROR_CODE_INVALID_ARGUMENTS;
+	}
+
+	if ( fileCount == 0 && rootCount == 0 && !filter )
+	{
+		log_warning( "No input files." );
+		return ERROR_CODE_NO_INPUT_FILES;
+	}
+
+	if ( tracePath )
+		trace_enable();
+
+	// Before anything is read into it. Without huge pages the arena just keeps its normal ones
+	if ( hugePages && !memory->use_huge_pages() )
+		log_warning( "Huge pages not available, using normal pages." );
+
+	// Only ever one stream and the skip engine, so the file options don't apply.
+	// The stats would be printed into the output, so they aren't kept
+	if ( filter )
+	{
+		if ( statsEnabled || manifestPath )
+			log_warning( "--stats and --manifest aren't used with -." );
+
+		bool filtered = strip_filter( &memory->transient );
+
+		if ( tracePath && !trace_write( tracePath ) )
+			log_warning( "Failed to write trace: %s", tracePath );
+
+		return ( filtered ? 0 : ERROR_CODE_FILTER_FAILED );
+	}
+
+	// A mapped file is read only and unmapped before it is written back to, so it can
+	// only be stripped into a copy. An explicit in-place or spans output reads instead
+	if ( input == STRIP_INPUT_MAP && output != STRIP_OUTPUT_COPY )
+	{
+		if ( outputSet )
+			input = STRIP_INPUT_READ;
+		else
+			output = STRIP_OUTPUT_COPY;
+	}
+
+	// Batches are stripped in place in the ring's buffer, and so are the files they pass on
+	if ( input == STRIP_INPUT_URING )
+		output = STRIP_OUTPUT_IN_PLACE;
+
+	// Batches already overlap their reads and writes, and a streamed file is never held whole
+	if ( pipeline && ( stream || input == STRIP_INPUT_URING ) )
+	{
+		log( "The pipeline isn't used with --stream or --input uring." );
+		pipeline = false;
+	}
+
+	// The pipeline reads into its budget and strips in place there, as do the files it passes on
+	if ( pipeline )
+	{
+		input = STRIP_INPUT_READ;
+		output = STRIP_OUTPUT_IN_PLACE;
+	}
+
+	log( "Engine: %s", STRIP_ENGINE_NAMES[ engine ] );
+	log( "Input: %s", STRIP_INPUT_NAMES[ input ] );
+	log( "Output: %s", STRIP_OUTPUT_NAMES[ output ] );
+
+	// Files are looked up by the path they were given as, so a run only skips
+	// files that were named the same way last time
+	Manifest manifest;
+
+	if ( manifestPath )
+	{
+		// Only the manifest's records use the pool
+		if ( !memory->init_pool( GB( 4ull ) ) )
+		{
+			log_warning( "Failed to initialise memory pool." );
+			return ERROR_CODE_FAILED_TO_INITIALISE_MEMORY_ARENA;
+		}
+
+		manifest_load( &manifest, manifestPath, &memory->pool );
+		log( "Manifest: %s ( %" PRIu64 " files )", manifestPath, manifest.header ? manifest.header->entryCount : 0 );
+	}
+
+	StripOptions options =
+	{
+		.engine = engine,
+		.input = input,
+		.output = output,
+		.stream = stream,
+		.splitThreads = 1,
+		.manifest = manifestPath ? &manifest : nullptr,
+	};
+
+	StripJob job =
+	{
+		.options = &options,
+		.files = argv,
+		.arenas = { memory },
+		.stages = {},
+		.batches = {},
+		.stats = {},
+		.splitPools = {},
+	};
+
+	// Every worker gets its own arena, so transient allocations are never shared.
+	// A walk can find any number of files, so it always gets every thread. The
+	// pipeline strips on one, its other threads only ever read and write
+	u32 workerCount = min( rootCount > 0 ? jobs : min( jobs, static_cast<u32>( fileCount ) ), THREAD_MAX_WORKERS );
+
+	if ( pipeline )
+		workerCount = 1;
+
+	for ( u32 worker = 1; worker < workerCount; ++worker )
+	{
+		MemoryArena *arena = memory->permanent.allocate<MemoryArena>();
+
+		if ( arena )
+		{
+			*arena = memory_default();
+
+			if ( !arena->init_virtual( MB( 16 ), GB( 64ull ), MB( 64 ), MB( 64 ) ) && !arena->init( KB( 1 ), MB( 32 ), KB( 0 ) ) )
+				arena = nullptr;
+			else if ( hugePages && !arena->use_huge_pages() )
+				log( "Huge pages not available for worker %u.", worker );
+		}
+
+		if ( !arena )
+		{
+			log_warning( "Failed to initialise memory arena for worker %u.", worker );
+			workerCount = worker;
+			break;
+		}
+
+		job.arenas[ worker ] = arena;
+	}
+
+	log( "Threads: %u", workerCount );
+
+	// Each worker stages what it writes and publishes it a batch at a time
+	if ( durable )
+	{
+		for ( u32 worker = 0; worker < workerCount; ++worker )
+		{
+			job.stages[ worker ] = job.arenas[ worker ]->permanent.allocate<FileStage>( 1, true );
+
+			if ( !job.stages[ worker ] )
+			{
+				log_warning( "Failed to allocate memory ( %" PRIu64 " bytes )", sizeof( FileStage ) );
+				return ERROR_CODE_FAILED_TO_INITIALISE_MEMORY_ARENA;
+			}
+		}
+	}
+
+	// Each worker reads its files a batch at a time through a ring of its own. Without
+	// io_uring they are read one at a time instead
+	for ( u32 worker = 0; worker < workerCount && input == STRIP_INPUT_URING && !stream; ++worker )
+	{
+		MemoryArena *arena = job.arenas[ worker ];
+		StripBatch *batch = arena->permanent.allocate<StripBatch>();
+
+		if ( !batch || !file_ring_init( &batch->ring, STRIP_BATCH_BUFFER_SIZE, &arena->permanent ) )
+		{
+			log( "io_uring not available, reading files with stdio." );
+
+			for ( u32 i = 0; i < worker; ++i )
+			{
+				file_ring_free( &job.batches[ i ]->ring );
+				job.batches[ i ] = nullptr;
+			}
+
+			options.input = STRIP_INPUT_READ;
+			break;
+		}
+
+		batch->count = 0;
+		job.batches[ worker ] = batch;
+	}
+
+	// Each worker counts for itself, and so do the pipeline's reader and writer
+	StripStats *threadStats[ THREAD_MAX_WORKERS + 2 ] = {};
+	u32 statsCount = ( statsEnabled ? workerCount + ( pipeline ? 2 : 0 ) : 0 );
+	MemoryArena *statsFileArena = ( statsFiles ? strip_stats_create_files( &memory->permanent ) : nullptr );
+
+	for ( u32 i = 0; i < statsCount; ++i )
+	{
+		threadStats[ i ] = strip_stats_create( &memory->permanent, statsFileArena );
+
+		if ( !threadStats[ i ] )
+		{
+			log_warning( "Failed to allocate memory ( %" PRIu64 " bytes )", sizeof( StripStats ) );
+			return ERROR_CODE_FAILED_TO_INITIALISE_MEMORY_ARENA;
+		}
+
+		if ( i < workerCount )
+			job.stats[ i ] = threadStats[ i ];
+	}
+
+	stats = threadStats[ 0 ];
+
+	for ( u32 worker = 0; worker < workerCount && statsEnabled; ++worker )
+		job.arenas[ worker ]->enable_stats();
+
+	ThreadPool *pool = memory->permanent.allocate<ThreadPool>();
+
+	if ( !pool )
+	{
+		log_warning( "Failed to allocate memory ( %" PRIu64 " bytes )", sizeof( ThreadPool ) );
+		return ERROR_CODE_FAILED_TO_INITIALISE_MEMORY_ARENA;
+	}
+
+	// Any threads asked for go to splitting up the big files
+	StripPipeline stripPipeline;
+	bool piped = false;
+
+	if ( pipeline )
+	{
+		stripPipeline.options = &options;
+		stripPipeline.arena = memory;
+		stripPipeline.stage = job.stages[ 0 ];
+		stripPipeline.files = argv;
+		stripPipeline.fileCount = fileCount;
+		stripPipeline.roots = roots;
+		stripPipeline.rootCount = rootCount;
+		stripPipeline.budget = memory->permanent.allocate<u8>( STRIP_PIPELINE_BUDGET, false, 64 );
+		stripPipeline.budgetSize = STRIP_PIPELINE_BUDGET;
+		stripPipeline.allocated = 0;
+		stripPipeline.readerStats = threadStats[ 1 ];
+		stripPipeline.writerStats = threadStats[ 2 ];
+
+		options.splitThreads = jobs;
+		stripPipeline.splitPool = strip_split_pool_create( &memory->permanent, jobs );
 
-		if ( write_file( filepath, newFile, dst - newFile, false ) == 0 )
+		if ( !stripPipeline.budget )
+			log_warning( "Failed to allocate memory ( %" PRIu64 " bytes )", STRIP_PIPELINE_BUDGET );
+		else if ( !( piped = strip_pipeline_run( &stripPipeline ) ) )
+			log_warning( "Failed to start the pipeline threads." );
+
+		strip_split_pool_free( stripPipeline.splitPool );
+		splitPool = nullptr;
+	}
+
+	if ( fileCount > 0 && !piped )
+	{
+		// With fewer files than threads, the rest go to splitting the files up
+		u32 fileWorkerCount = min( workerCount, static_cast<u32>( fileCount ) );
+		options.splitThreads = max( jobs / fileWorkerCount, 1u );
+
+		for ( u32 worker = 0; worker < fileWorkerCount; ++worker )
+			job.splitPools[ worker ] = strip_split_pool_create( &memory->permanent, options.splitThreads );
+
+		thread_pool_run( pool, fileWorkerCount, fileCount, strip_job_task, &job );
+
+		for ( u32 worker = 0; worker < fileWorkerCount; ++worker )
 		{
-			log_warning( "Failed to write file: %s", filepath );
+			strip_split_pool_free( job.splitPools[ worker ] );
+			job.splitPools[ worker ] = nullptr;
 		}
+	}
+
+	// Files are stripped as soon as they are found, on whichever worker found them
+	if ( rootCount > 0 && !piped )
+	{
+		options.splitThreads = 1;
+
+		if ( !walk_directories( roots, rootCount, workerCount, strip_walk_filter, strip_walk_file, &job ) )
+			log_warning( "Failed to walk every directory." );
+	}
+
+	// Batches that never filled up, each worker still has one
+	if ( job.batches[ 0 ] )
+	{
+		thread_pool_run( pool, workerCount, workerCount, strip_job_flush_task, &job );
+
+		for ( u32 worker = 0; worker < workerCount; ++worker )
+			file_ring_free( &job.batches[ worker ]->ring );
+	}
 
-		memory->transient.free( newFile );
-		memory->transient.free( file );
+	// Whatever is still staged is published before the manifest says it was written
+	for ( u32 worker = 0; worker < workerCount && durable; ++worker )
+	{
+		u64 start = strip_stats_start( STRIP_PHASE_WRITE );
+
+		if ( !commit_staged_files( job.stages[ worker ] ) )
+			log_warning( "Failed to publish every staged file." );
+
+		strip_stats_stop_shared( STRIP_PHASE_WRITE, start );
+	}
+
+	if ( manifestPath )
+	{
+		manifest_save( &manifest, manifestPath, &memory->transient );
+		manifest_free( &manifest );
+	}
+
+	if ( statsEnabled )
+	{
+		strip_stats_report( threadStats, statsCount, job.arenas, workerCount, statsFormat );
+
+		if ( statsFileArena )
+			statsFileArena->free();
 	}
 
+	for ( u32 worker = 1; worker < workerCount; ++worker )
+		job.arenas[ worker ]->free();
+
+	// Every thread but this one is gone, so nothing is still recording
+	if ( tracePath && !trace_write( tracePath ) )
+		log_warning( "Failed to write trace: %s", tracePath );
+
 	return 0;
 }
 
 // -- UNITY BUILD --
 #if defined( __PLATFORM_WINDOWS__ )
 #include "platform_windows.cpp"
+#elif defined( __PLATFORM_LINUX__ )
+#include "platform_linux.cpp"
 #else
 #warning No Platform Selected.
 #endif
@@ -169,3 +2125,15 @@ int main( int argc, char *argv[] )
 
 #define MEMORY_FUNCTIONS_IMPLEMENTATION
 #include "memory_functions.h"
+
+#define STRIP_FUNCTIONS_IMPLEMENTATION
+#include "strip_functions.h"
+
+#define THREAD_FUNCTIONS_IMPLEMENTATION
+#include "thread_functions.h"
+
+#define TRACE_FUNCTIONS_IMPLEMENTATION
+#include "trace_functions.h"
+
+#define MANIFEST_FUNCTIONS_IMPLEMENTATION
+#include "manifest_functions.h"
@@ -0,0 +1,541 @@
+
+#ifndef _HG_MANIFEST_FUNCTIONS
+#define _HG_MANIFEST_FUNCTIONS
+
+#include <mutex>
+
+// Remembers what every stripped file looked like after it was written, so a later run can skip
+// it without reading it. The file is a header, the entries sorted by path hash and then the
+// paths, all in native byte order so it can be mapped and searched as it is
+constexpr const char MANIFEST_ID[ 4 ] = { 'S', 'T', 'M', 'F' };
+constexpr const u32 MANIFEST_VERSION = 1;
+
+struct ManifestHeader
+{
+	char id[ 4 ];
+	u32 version;
+	u64 entryCount;
+	u64 stringBytes;
+	u64 timestamp;			// when it was saved, files edited in the same second aren't trusted
+};
+
+struct ManifestEntry
+{
+	u64 pathHash;
+	u64 size;				// of the file after it was written
+	u64 timestamp;			// last edit, from file_last_edit_timestamp
+	u64 hash;				// of the contents that were written
+	u32 pathOffset;			// into the paths, which are null terminated
+	u32 pathBytes;			// without the null terminator
+};
+
+static_assert( sizeof( ManifestHeader ) % alignof( ManifestEntry ) == 0 );
+
+using ManifestStatus = u8;
+enum MANIFEST_STATUS : ManifestStatus
+{
+	MANIFEST_STATUS_CHANGED,
+	MANIFEST_STATUS_UNCHANGED,
+	MANIFEST_STATUS_RACY,			// matches, but was edited as the manifest was saved so its contents have to be checked
+};
+
+struct Manifest
+{
+	// The previous run, read only
+	MappedFile mapped = {};
+	const ManifestHeader *header = nullptr;
+	const ManifestEntry *entries = nullptr;
+	const char *strings = nullptr;
+
+	// Files written by this run, added to from every worker. The records and their paths take
+	// turns growing, so each one frees a block the other can use next
+	std::mutex mutex;
+	Allocator *allocator = nullptr;		// only used under the mutex
+	ManifestEntry *records = nullptr;
+	char *recordStrings = nullptr;
+	u64 recordCount = 0;
+	u64 recordCapacity = 0;
+	u64 recordStringBytes = 0;
+	u64 recordStringCapacity = 0;
+};
+
+// XXH64, fed in pieces so output that is written in chunks can be hashed as it goes
+struct ManifestHash
+{
+	u64 lanes[ 4 ];
+	u64 length;
+	u8 buffer[ 32 ];
+	u32 buffered;
+};
+
+void manifest_hash_begin( ManifestHash *hash );
+void manifest_hash_update( ManifestHash *hash, const void *data, u64 size );
+[[nodiscard]] u64 manifest_hash_end( const ManifestHash *hash );
+[[nodiscard]] u64 manifest_hash( const void *data, u64 size );
+
+// A missing manifest loads as an empty one, a damaged one is ignored with a warning. The records
+// come from allocator, which has to free blocks in any order and is left to the manifest
+bool manifest_load( Manifest *manifest, const char *path, Allocator *allocator );
+[[nodiscard]] const ManifestEntry *manifest_find( const Manifest *manifest, const char *path );
+[[nodiscard]] ManifestStatus manifest_check( const Manifest *manifest, const char *path, u64 size, u64 timestamp, const ManifestEntry **entry );
+bool manifest_record( Manifest *manifest, const char *path, u64 size, u64 timestamp, u64 hash );
+
+// Writes the loaded entries merged with the records, a record replaces the entry for its path.
+// Unmaps the loaded manifest, so nothing found before can be used after
+bool manifest_save( Manifest *manifest, const char *path, Allocator *allocator );
+void manifest_free( Manifest *manifest );
+
+#endif // _HG_MANIFEST_FUNCTIONS
+
+// --------------------------------------------------------------------------------
+
+#if defined( MANIFEST_FUNCTIONS_IMPLEMENTATION )
+
+constexpr const u64 MANIFEST_HASH_PRIME_1 = 0x9E3779B185EBCA87ull;
+constexpr const u64 MANIFEST_HASH_PRIME_2 = 0xC2B2AE3D27D4EB4Full;
+constexpr const u64 MANIFEST_HASH_PRIME_3 = 0x165667B19E3779F9ull;
+constexpr const u64 MANIFEST_HASH_PRIME_4 = 0x85EBCA77C2B2AE63ull;
+constexpr const u64 MANIFEST_HASH_PRIME_5 = 0x27D4EB2F165667C5ull;
+
+static inline u64 manifest_hash_rotl( u64 x, i32 k )
+{
+	return ( x << k ) | ( x >> ( 64 - k ) );
+}
+
+static inline u64 manifest_hash_read_u64( const u8 *p )
+{
+	u64 value;
+	memcpy( &value, p, sizeof( value ) );
+	return value;
+}
+
+static inline u32 manifest_hash_read_u32( const u8 *p )
+{
+	u32 value;
+	memcpy( &value, p, sizeof( value ) );
+	return value;
+}
+
+static inline u64 manifest_hash_round( u64 lane, u64 input )
+{
+	lane += input * MANIFEST_HASH_PRIME_2;
+	lane = manifest_hash_rotl( lane, 31 );
+	return lane * MANIFEST_HASH_PRIME_1;
+}
+
+static inline u64 manifest_hash_merge( u64 hash, u64 lane )
+{
+	hash ^= manifest_hash_round( 0, lane );
+	return hash * MANIFEST_HASH_PRIME_1 + MANIFEST_HASH_PRIME_4;
+}
+
+// The four lanes are independent, so a 32 byte stripe doesn't wait on the one before it
+static inline void manifest_hash_stripe( u64 *lanes, const u8 *p )
+{
+	lanes[ 0 ] = manifest_hash_round( lanes[ 0 ], manifest_hash_read_u64( p ) );
+	lanes[ 1 ] = manifest_hash_round( lanes[ 1 ], manifest_hash_read_u64( p + 8 ) );
+	lanes[ 2 ] = manifest_hash_round( lanes[ 2 ], manifest_hash_read_u64( p + 16 ) );
+	lanes[ 3 ] = manifest_hash_round( lanes[ 3 ], manifest_hash_read_u64( p + 24 ) );
+}
+
+void manifest_hash_begin( ManifestHash *hash )
+{
+	hash->lanes[ 0 ] = MANIFEST_HASH_PRIME_1 + MANIFEST_HASH_PRIME_2;
+	hash->lanes[ 1 ] = MANIFEST_HASH_PRIME_2;
+	hash->lanes[ 2 ] = 0;
+	hash->lanes[ 3 ] = 0 - MANIFEST_HASH_PRIME_1;
+	hash->length = 0;
+	hash->buffered = 0;
+}
+
+void manifest_hash_update( ManifestHash *hash, const void *data, u64 size )
+{
+	if ( size == 0 )
+		return;
+
+	const u8 *p = static_cast<const u8 *>( data );
+	const u8 *end = p + size;
+
+	hash->length += size;
+
+	// Top up a stripe left over from the last piece
+	if ( hash->buffered > 0 )
+	{
+		u64 take = min<u64>( sizeof( hash->buffer ) - hash->buffered, size );
+		memcpy( hash->buffer + hash->buffered, p, take );
+		hash->buffered += static_cast<u32>( take );
+		p += take;
+
+		if ( hash->buffered < sizeof( hash->buffer ) )
+			return;
+
+		manifest_hash_stripe( hash->lanes, hash->buffer );
+		hash->buffered = 0;
+	}
+
+	for ( ; end - p >= 32; p += 32 )
+		manifest_hash_stripe( hash->lanes, p );
+
+	memcpy( hash->buffer, p, end - p );
+	hash->buffered = static_cast<u32>( end - p );
+}
+
+u64 manifest_hash_end( const ManifestHash *hash )
+{
+	u64 result;
+
+	if ( hash->length >= 32 )
+	{
+		const u64 *lanes = hash->lanes;
+
+		result = manifest_hash_rotl( lanes[ 0 ], 1 ) + manifest_hash_rotl( lanes[ 1 ], 7 ) + manifest_hash_rotl( lanes[ 2 ], 12 ) + manifest_hash_rotl( lanes[ 3 ], 18 );
+		result = manifest_hash_merge( result, lanes[ 0 ] );
+		result = manifest_hash_merge( result, lanes[ 1 ] );
+		result = manifest_hash_merge( result, lanes[ 2 ] );
+		result = manifest_hash_merge( result, lanes[ 3 ] );
+	}
+	else
+	{
+		result = MANIFEST_HASH_PRIME_5;
+	}
+
+	result += hash->length;
+
+	const u8 *p = hash->buffer;
+	const u8 *end = p + hash->buffered;
+
+	for ( ; end - p >= 8; p += 8 )
+	{
+		result ^= manifest_hash_round( 0, manifest_hash_read_u64( p ) );
+		result = manifest_hash_rotl( result, 27 ) * MANIFEST_HASH_PRIME_1 + MANIFEST_HASH_PRIME_4;
+	}
+
+	if ( end - p >= 4 )
+	{
+		result ^= static_cast<u64>( manifest_hash_read_u32( p ) ) * MANIFEST_HASH_PRIME_1;
+		result = manifest_hash_rotl( result, 23 ) * MANIFEST_HASH_PRIME_2 + MANIFEST_HASH_PRIME_3;
+		p += 4;
+	}
+
+	for ( ; p < end; ++p )
+	{
+		result ^= *p * MANIFEST_HASH_PRIME_5;
+		result = manifest_hash_rotl( result, 11 ) * MANIFEST_HASH_PRIME_1;
+	}
+
+	result ^= result >> 33;
+	result *= MANIFEST_HASH_PRIME_2;
+	result ^= result >> 29;
+	result *= MANIFEST_HASH_PRIME_3;
+	result ^= result >> 32;
+
+	return result;
+}
+
+u64 manifest_hash( const void *data, u64 size )
+{
+	ManifestHash hash;
+	manifest_hash_begin( &hash );
+	manifest_hash_update( &hash, data, size );
+	return manifest_hash_end( &hash );
+}
+
+bool manifest_load( Manifest *manifest, const char *path, Allocator *allocator )
+{
+	manifest->allocator = allocator;
+
+	if ( !file_exists( path ) )
+		return true;
+
+	if ( !map_file( path, &manifest->mapped ) )
+		return false;
+
+	const u8 *data = manifest->mapped.data;
+	u64 size = manifest->mapped.size;
+	const ManifestHeader *header = reinterpret_cast<const ManifestHeader *>( data );
+
+	// Everything has to add up to the size of the file, so the entries can be trusted to be there
+	bool valid = size >= sizeof( ManifestHeader )
+		&& memcmp( header->id, MANIFEST_ID, sizeof( MANIFEST_ID ) ) == 0
+		&& header->version == MANIFEST_VERSION
+		&& header->entryCount <= ( size - sizeof( ManifestHeader ) ) / sizeof( ManifestEntry )
+		&& header->stringBytes == size - sizeof( ManifestHeader ) - header->entryCount * sizeof( ManifestEntry );
+
+	if ( !valid )
+	{
+		log_warning( "Ignoring damaged manifest: %s", path );
+		unmap_file( &manifest->mapped );
+		return false;
+	}
+
+	manifest->header = header;
+	manifest->entries = reinterpret_cast<const ManifestEntry *>( data + sizeof( ManifestHeader ) );
+	manifest->strings = reinterpret_cast<const char *>( manifest->entries + header->entryCount );
+
+	return true;
+}
+
+const ManifestEntry *manifest_find( const Manifest *manifest, const char *path )
+{
+	if ( !manifest->header )
+		return nullptr;
+
+	u64 pathBytes = string_utf8_bytes( path ) - 1;
+	u64 pathHash = manifest_hash( path, pathBytes );
+
+	// First entry with the hash
+	u64 low = 0;
+	u64 high = manifest->header->entryCount;
+
+	while ( low < high )
+	{
+		u64 middle = low + ( high - low ) / 2;
+
+		if ( manifest->entries[ middle ].pathHash < pathHash )
+			low = middle + 1;
+		else
+			high = middle;
+	}
+
+	for ( ; low < manifest->header->entryCount && manifest->entries[ low ].pathHash == pathHash; ++low )
+	{
+		const ManifestEntry *entry = &manifest->entries[ low ];
+
+		// Checked here rather than on load, so loading doesn't have to touch every entry
+		if ( entry->pathBytes != pathBytes || static_cast<u64>( entry->pathOffset ) + pathBytes >= manifest->header->stringBytes )
+			continue;
+
+		if ( memcmp( manifest->strings + entry->pathOffset, path, pathBytes ) == 0 )
+			return entry;
+	}
+
+	return nullptr;
+}
+
+ManifestStatus manifest_check( const Manifest *manifest, const char *path, u64 size, u64 timestamp, const ManifestEntry **entry )
+{
+	*entry = manifest_find( manifest, path );
+
+	if ( !*entry || timestamp == 0 || ( *entry )->size != size || ( *entry )->timestamp != timestamp )
+		return MANIFEST_STATUS_CHANGED;
+
+	// The timestamps only have a second of resolution, so a file written in the second the
+	// manifest was saved could have been edited again since without its timestamp changing
+	if ( ( *entry )->timestamp >= manifest->header->timestamp )
+		return MANIFEST_STATUS_RACY;
+
+	return MANIFEST_STATUS_UNCHANGED;
+}
+
+bool manifest_record( Manifest *manifest, const char *path, u64 size, u64 timestamp, u64 hash )
+{
+	u64 pathBytes = string_utf8_bytes( path ) - 1;
+
+	std::lock_guard<std::mutex> lock( manifest->mutex );
+
+	if ( manifest->recordCount == manifest->recordCapacity )
+	{
+		u64 capacity = max<u64>( manifest->recordCapacity * 2, 1024 );
+		ManifestEntry *records = manifest->allocator->reallocate<ManifestEntry>( manifest->records, capacity );
+
+		if ( !records )
+		{
+			log_warning( "Failed to allocate memory ( %" PRIu64 " bytes )", capacity * sizeof( ManifestEntry ) );
+			return false;
+		}
+
+		manifest->records = records;
+		manifest->recordCapacity = capacity;
+	}
+
+	if ( manifest->recordStringBytes + pathBytes + 1 > manifest->recordStringCapacity )
+	{
+		u64 capacity = max<u64>( manifest->recordStringCapacity * 2, manifest->recordStringBytes + pathBytes + 1 );
+		capacity = max<u64>( capacity, KB( 64 ) );
+		char *strings = manifest->allocator->reallocate<char>( manifest->recordStrings, capacity );
+
+		if ( !strings )
+		{
+			log_warning( "Failed to allocate memory ( %" PRIu64 " bytes )", capacity );
+			return false;
+		}
+
+		manifest->recordStrings = strings;
+		manifest->recordStringCapacity = capacity;
+	}
+
+	ManifestEntry *record = &manifest->records[ manifest->recordCount++ ];
+	record->pathHash = manifest_hash( path, pathBytes );
+	record->size = size;
+	record->timestamp = timestamp;
+	record->hash = hash;
+	record->pathOffset = static_cast<u32>( manifest->recordStringBytes );
+	record->pathBytes = static_cast<u32>( pathBytes );
+
+	memcpy( manifest->recordStrings + manifest->recordStringBytes, path, pathBytes + 1 );
+	manifest->recordStringBytes += pathBytes + 1;
+
+	return true;
+}
+
+// Entries and records sorted together, the later of two with the same path wins
+struct ManifestSaveItem
+{
+	const ManifestEntry *entry;
+	const char *path;
+	u64 order;
+};
+
+static i32 manifest_save_compare( const void *lhs, const void *rhs )
+{
+	const ManifestSaveItem *a = static_cast<const ManifestSaveItem *>( lhs );
+	const ManifestSaveItem *b = static_cast<const ManifestSaveItem *>( rhs );
+
+	if ( a->entry->pathHash != b->entry->pathHash )
+		return a->entry->pathHash < b->entry->pathHash ? -1 : 1;
+
+	if ( a->entry->pathBytes != b->entry->pathBytes )
+		return a->entry->pathBytes < b->entry->pathBytes ? -1 : 1;
+
+	if ( i32 order = memcmp( a->path, b->path, a->entry->pathBytes ) )
+		return order;
+
+	return a->order < b->order ? -1 : ( a->order > b->order ? 1 : 0 );
+}
+
+static inline bool manifest_save_same_path( const ManifestSaveItem *a, const ManifestSaveItem *b )
+{
+	return a->entry->pathHash == b->entry->pathHash
+		&& a->entry->pathBytes == b->entry->pathBytes
+		&& memcmp( a->path, b->path, a->entry->pathBytes ) == 0;
+}
+
+bool manifest_save( Manifest *manifest, const char *path, Allocator *allocator )
+{
+	// Nothing was written, so the manifest on disk is still right
+	if ( manifest->recordCount == 0 )
+	{
+		unmap_file( &manifest->mapped );
+		manifest->header = nullptr;
+		return true;
+	}
+
+	u64 entryCount = ( manifest->header ? manifest->header->entryCount : 0 );
+	u64 itemCount = entryCount + manifest->recordCount;
+	ManifestSaveItem *items = allocator->allocate<ManifestSaveItem>( itemCount );
+
+	if ( !items )
+	{
+		log_warning( "Failed to allocate memory ( %" PRIu64 " bytes )", itemCount * sizeof( ManifestSaveItem ) );
+		return false;
+	}
+
+	u64 count = 0;
+
+	for ( u64 i = 0; i < entryCount; ++i )
+	{
+		const ManifestEntry *entry = &manifest->entries[ i ];
+
+		if ( static_cast<u64>( entry->pathOffset ) + entry->pathBytes < manifest->header->stringBytes )
+		{
+			items[ count ] = { entry, manifest->strings + entry->pathOffset, count };
+			count += 1;
+		}
+	}
+
+	for ( u64 i = 0; i < manifest->recordCount; ++i )
+	{
+		const ManifestEntry *record = &manifest->records[ i ];
+		items[ count ] = { record, manifest->recordStrings + record->pathOffset, count };
+		count += 1;
+	}
+
+	qsort( items, count, sizeof( ManifestSaveItem ), manifest_save_compare );
+
+	// Drop everything but the last of each path
+	u64 kept = 0;
+	u64 stringBytes = 0;
+
+	for ( u64 i = 0; i < count; ++i )
+	{
+		if ( i + 1 < count && manifest_save_same_path( &items[ i ], &items[ i + 1 ] ) )
+			continue;
+
+		items[ kept++ ] = items[ i ];
+		stringBytes += items[ i ].entry->pathBytes + 1;
+	}
+
+	u64 size = sizeof( ManifestHeader ) + kept * sizeof( ManifestEntry ) + stringBytes;
+	u8 *buffer = allocator->allocate<u8>( size, false, alignof( ManifestEntry ) );
+
+	if ( !buffer || stringBytes > UINT32_MAX )
+	{
+		log_warning( "Failed to allocate memory ( %" PRIu64 " bytes )", size );
+		allocator->free( buffer );
+		allocator->free( items );
+		return false;
+	}
+
+	ManifestHeader *header = reinterpret_cast<ManifestHeader *>( buffer );
+	memcpy( header->id, MANIFEST_ID, sizeof( MANIFEST_ID ) );
+	header->version = MANIFEST_VERSION;
+	header->entryCount = kept;
+	header->stringBytes = stringBytes;
+	header->timestamp = static_cast<u64>( time( nullptr ) );
+
+	ManifestEntry *entries = reinterpret_cast<ManifestEntry *>( buffer + sizeof( ManifestHeader ) );
+	char *strings = reinterpret_cast<char *>( entries + kept );
+	u64 offset = 0;
+
+	for ( u64 i = 0; i < kept; ++i )
+	{
+		entries[ i ] = *items[ i ].entry;
+		entries[ i ].pathOffset = static_cast<u32>( offset );
+
+		memcpy( strings + offset, items[ i ].path, entries[ i ].pathBytes );
+		strings[ offset + entries[ i ].pathBytes ] = '\0';
+		offset += entries[ i ].pathBytes + 1;
+	}
+
+	// The old manifest is still mapped and is about to be replaced
+	unmap_file( &manifest->mapped );
+	manifest->header = nullptr;
+	manifest->entries = nullptr;
+	manifest->strings = nullptr;
+
+	// Written next to it and moved over it, so a run that dies part way leaves the old one
+	char tempPath[ MAX_FILEPATH ];
+	snprintf( tempPath, sizeof( tempPath ), "%s.TEMP", path );
+
+	bool result = write_file( tempPath, buffer, size, false ) == size
+		&& move_file( tempPath, path, FILE_MOVE_REPLACE | FILE_MOVE_ERROR_LOG );
+
+	if ( !result )
+		log_warning( "Failed to write manifest: %s", path );
+
+	allocator->free( buffer );
+	allocator->free( items );
+
+	return result;
+}
+
+void manifest_free( Manifest *manifest )
+{
+	unmap_file( &manifest->mapped );
+	manifest->header = nullptr;
+	manifest->entries = nullptr;
+	manifest->strings = nullptr;
+
+	if ( manifest->allocator )
+	{
+		manifest->allocator->free( manifest->records );
+		manifest->allocator->free( manifest->recordStrings );
+	}
+
+	manifest->records = nullptr;
+	manifest->recordStrings = nullptr;
+	manifest->recordCount = manifest->recordCapacity = 0;
+	manifest->recordStringBytes = manifest->recordStringCapacity = 0;
+}
+
+#endif
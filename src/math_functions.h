@@ -2,6 +2,23 @@
 #ifndef _HG_MATH_FUNCTIONS
 #define _HG_MATH_FUNCTIONS
 
+// glibc defines these as macros
+#if !defined( _MSC_VER )
+	#undef M_PI
+	#undef M_PI_2
+	#undef M_PI_4
+	#undef M_1_PI
+	#undef M_2_PI
+	#undef M_2_SQRTPI
+	#undef M_SQRT2
+	#undef M_SQRT1_2
+	#undef M_E
+	#undef M_LOG2E
+	#undef M_LOG10E
+	#undef M_LN2
+	#undef M_LN10
+#endif
+
 constexpr const f32 M_TAU				= 6.28318530717958647692f;
 constexpr const f32 M_PI				= 3.14159265358979323846f;
 constexpr const f32 M_PI_2				= 1.57079632679489661923f;
@@ -419,7 +436,7 @@ inline vec2 &operator /= ( vec2 &lhs, f32 rhs )
 	return lhs.x * rhs.x + lhs.y * rhs.y;
 }
 
-[[nodiscard]] inline f32 magnitude( const vec2 &vec )
+[[nodiscard]] constexpr inline f32 magnitude( const vec2 &vec )
 {
 	return sqrtf( vec.x * vec.x + vec.y * vec.y );
 }
@@ -632,7 +649,7 @@ inline vec3 &operator /= ( vec3 &lhs, f32 rhs )
 	return lhs.x * rhs.x + lhs.y * rhs.y + lhs.z * rhs.z;
 }
 
-[[nodiscard]] inline f32 magnitude( const vec3 &vec )
+[[nodiscard]] constexpr inline f32 magnitude( const vec3 &vec )
 {
 	return sqrtf( vec.x * vec.x + vec.y * vec.y + vec.z * vec.z );
 }
@@ -876,7 +893,7 @@ inline vec4 &operator /= ( vec4 &lhs, f32 rhs )
 	return lhs.x * rhs.x + lhs.y * rhs.y + lhs.z * rhs.z + lhs.w * rhs.w;
 }
 
-[[nodiscard]] inline f32 magnitude( const vec4 &vec )
+[[nodiscard]] constexpr inline f32 magnitude( const vec4 &vec )
 {
 	return sqrtf( vec.x * vec.x + vec.y * vec.y + vec.z * vec.z + vec.w * vec.w );
 }
@@ -1690,7 +1707,7 @@ constexpr inline void identity( Quaternion &quat )
 	return lhs.x * rhs.x + lhs.y * rhs.y + lhs.z * rhs.z + lhs.w * rhs.w;
 }
 
-[[nodiscard]] inline f32 magnitude( const Quaternion &quat )
+[[nodiscard]] constexpr inline f32 magnitude( const Quaternion &quat )
 {
 	return sqrtf( quat.x * quat.x + quat.y * quat.y + quat.z * quat.z + quat.w * quat.w );
 }
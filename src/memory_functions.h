@@ -2,19 +2,26 @@
 #ifndef _HG_MEMORY_FUNCTIONS
 #define _HG_MEMORY_FUNCTIONS
 
+#include <atomic>
+
 constexpr const u64 MEMORY_ALIGNMENT = sizeof( u64* );
+constexpr const u64 MEMORY_COMMIT_GRANULARITY = KB( 64 );	// virtual memory is committed in steps of this
 
 using MemoryFlags = u32;
 enum MEMORY_FLAGS : MemoryFlags
 {
 	MEMORY_FLAG_INITIALISED				= 1 << 0,
 	MEMORY_FLAG_SEPARATE_ALLOCATIONS	= 1 << 1,
+	MEMORY_FLAG_VIRTUAL_MEMORY			= 1 << 2,
 };
 
 using AllocatorFlags = u64;
 enum ALLOCATOR_FLAGS : AllocatorFlags
 {
 	ALLOCATOR_FLAG_VOLATILE_MEMORY		= 1 << 0,
+	ALLOCATOR_FLAG_VIRTUAL_MEMORY		= 1 << 1,
+	ALLOCATOR_FLAG_STATS				= 1 << 2,		// keeps AllocatorStats up to date
+	ALLOCATOR_FLAG_HUGE_PAGES			= 1 << 3,		// reserved on huge pages, and committed a whole one at a time
 };
 
 struct MemoryHeader
@@ -29,13 +36,65 @@ struct MemoryHeader
 
 static_assert( sizeof( MemoryHeader ) % MEMORY_ALIGNMENT == 0 );
 
+constexpr const u64 MEMORY_CONCURRENT_BLOCK = KB( 64 );		// each thread carves small allocations from one of these
+constexpr const u64 MEMORY_CONCURRENT_SMALL = KB( 8 );
+
+// Sits right before the data of a concurrent allocation
+struct MemoryConcurrentHeader
+{
+	u64 size;				// size requested
+	u64 alignment;
+};
+
+constexpr const u64 MEMORY_POOL_MIN_BLOCK = 32;		// blocks are this times a power of two
+constexpr const u32 MEMORY_POOL_BIN_COUNT = 48;
+
+// Sits right before the data of a pool block
+struct MemoryPoolHeader
+{
+	u32 bin;				// the block is MEMORY_POOL_MIN_BLOCK << bin bytes
+	u16 offset;				// from the start of the block to the data
+	u16 alignment;
+	u64 size;				// size requested
+};
+
+static_assert( sizeof( MemoryPoolHeader ) == 16 );
+
+// The start of a pool's memory. A free block keeps the next free block of its size in its first bytes
+struct alignas( 64 ) MemoryPoolBins
+{
+	u8 *free[ MEMORY_POOL_BIN_COUNT ];
+	u64 inUse;				// bytes of every block handed out and not yet freed
+};
+
+// How far a bump allocator had got. Rewinding to it gives back everything allocated since in one step
+struct ArenaMarker
+{
+	u64 available;
+	u8 *lastAlloc;
+};
+
+// Only counted with ALLOCATOR_FLAG_STATS. Arena resets don't clear them, so they cover the run
+struct AllocatorStats
+{
+	u64 allocations;
+	u64 frees;				// blocks given back, a rewind past attached blocks counts each of them
+	u64 failed;
+	u64 bytes;				// asked for, including what reallocations grew by
+	u64 padding;			// lost to alignment
+	u64 headers;			// lost to MemoryHeaders
+	u64 peak;				// most ever in use at once, padding and headers included
+};
+
 struct Allocator
 {
 	AllocatorFlags flags;
 	u64 capacity;
 	u64 available;
+	u64 committed;			// bytes from the start of memory that are backed, capacity unless virtual
 	u8 *memory;
 	u8 *lastAlloc;
+	u64 epoch;				// new whenever the memory is handed out from the start again
 
 	u8 *( *allocate_func )( Allocator *allocator, u64 size, bool clearZero, u16 alignment );
 	u8 *( *reallocate_func )( Allocator *allocator, void *p, u64 size );
@@ -43,6 +102,8 @@ struct Allocator
 	void ( *free_func )( Allocator *allocator, void *p );
 	void ( *attach_func )( Allocator *allocator, void *p, void *to );
 
+	AllocatorStats stats;
+
 	// METHODS ////////////////////////////////////
 	template <typename T> [[nodiscard]] inline T *allocate( u64 count = 1, bool clearZero = false );
 	template <typename T> [[nodiscard]] inline T *allocate( u64 count, bool clearZero, u16 alignment );
@@ -51,19 +112,40 @@ struct Allocator
 	inline void shrink_to_bytes( void *p, u64 size );
 	inline void free( void *p );
 	inline void attach( void *p, void *to );
+	[[nodiscard]] inline ArenaMarker mark() const;
+	inline void rewind( ArenaMarker marker );
+};
+
+// Rewinds to where the allocator was when it goes out of scope, however it is left
+struct ArenaScope
+{
+	Allocator *allocator;
+	ArenaMarker marker;
+
+	explicit ArenaScope( Allocator *inAllocator ) : allocator( inAllocator ), marker( inAllocator->mark() ) {}
+	~ArenaScope() { allocator->rewind( marker ); }
+
+	ArenaScope( const ArenaScope & ) = delete;
+	ArenaScope &operator=( const ArenaScope & ) = delete;
 };
 
 struct MemoryArena
 {
 	bool init( u64 permanentSize, u64 transientSize, u64 fastBumpSize, bool clearZero = false, u16 alignment = MEMORY_ALIGNMENT );
+	bool init_virtual( u64 permanentReserve, u64 transientReserve, u64 fastBumpReserve, u64 highWater );
+	bool init_pool( u64 poolReserve );
+	bool use_huge_pages();
 	void free();
 	void update();
+	void enable_stats();
 
 	MemoryFlags flags = 0;
 	u8 *memory = nullptr;
+	u64 highWater = 0;		// committed memory kept by update(), the rest is given back
 	Allocator permanent = {};
 	Allocator transient = {};
 	Allocator fastBump = {};
+	Allocator pool = {};		// only once init_pool is called, update() leaves it alone
 };
 
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -109,20 +191,62 @@ inline void Allocator::attach( void *p, void *to )
 
 // -------------------------------
 
+[[nodiscard]] bool memory_commit( Allocator *allocator, u64 used );
+void memory_decommit( Allocator *allocator, u64 keep );
 [[nodiscard]] u8 *memory_bump_allocate( Allocator *allocator, u64 size, bool clearZero, u16 alignment );
 [[nodiscard]] u8 *memory_bump_reallocate( Allocator *allocator, void *p, u64 size );
 void memory_bump_shrink( Allocator *allocator, void *p, u64 size );
 void memory_bump_free( Allocator *allocator, void *p );
 void memory_bump_attach( Allocator *allocator, void *p, void *to );
 [[nodiscard]] u8 *memory_fast_bump_allocate( Allocator *allocator, u64 size, bool clearZero, u16 alignment );
+[[nodiscard]] u8 *memory_pool_allocate( Allocator *allocator, u64 size, bool clearZero, u16 alignment );
+[[nodiscard]] u8 *memory_pool_reallocate( Allocator *allocator, void *p, u64 size );
+void memory_pool_shrink( Allocator *allocator, void *p, u64 size );
+void memory_pool_free( Allocator *allocator, void *p );
+void memory_pool_attach( Allocator *allocator, void *p, void *to );
+
+// Turns an allocator no thread is using yet into one any number of threads can share. Only
+// update() and free() on its arena still need every thread to be done with it
+void memory_concurrent_init( Allocator *allocator );
+[[nodiscard]] u8 *memory_concurrent_allocate( Allocator *allocator, u64 size, bool clearZero, u16 alignment );
+[[nodiscard]] u8 *memory_concurrent_reallocate( Allocator *allocator, void *p, u64 size );
+void memory_concurrent_shrink( Allocator *allocator, void *p, u64 size );
+void memory_concurrent_free( Allocator *allocator, void *p );
+void memory_concurrent_attach( Allocator *allocator, void *p, void *to );
 [[nodiscard]] MemoryArena memory_default();
 
+// Only the bump allocators hand memory out in order, so only they can be rewound
+inline ArenaMarker Allocator::mark() const
+{
+	assert( allocate_func == memory_bump_allocate || allocate_func == memory_fast_bump_allocate );
+
+	return { available, lastAlloc };
+}
+
+inline void Allocator::rewind( ArenaMarker marker )
+{
+	// Something from before the mark was freed, rewinding would hand it out twice
+	assert( marker.available >= available );
+
+	available = marker.available;
+	lastAlloc = marker.lastAlloc;
+}
+
 #endif // _HG_MEMORY_FUNCTIONS
 
 // ----------------------------------------------------------------------------------
 
 #if defined( MEMORY_FUNCTIONS_IMPLEMENTATION )
 
+static std::atomic<u64> memoryEpochs = 0;
+
+// Unique over every allocator, so a block a thread kept from an arena that was freed and made
+// again at the same address is still seen as stale
+static inline u64 memory_next_epoch()
+{
+	return memoryEpochs.fetch_add( 1, std::memory_order_relaxed ) + 1;
+}
+
 bool MemoryArena::init( u64 permanentSize, u64 transientSize, u64 fastBumpSize, bool clearZero, u16 alignment )
 {
 	constexpr const u64 permanentMinSize = sizeof( Allocator ) + sizeof( MemoryHeader );
@@ -177,16 +301,19 @@ bool MemoryArena::init( u64 permanentSize, u64 transientSize, u64 fastBumpSize,
 
 	permanent.capacity = permanentSize;
 	permanent.available = permanentSize;
+	permanent.committed = permanentSize;
 	permanent.memory = permanentMemory;
 	permanent.lastAlloc = nullptr;
 
 	transient.capacity = transientSize;
 	transient.available = transientSize;
+	transient.committed = transientSize;
 	transient.memory = transientMemory;
 	transient.lastAlloc = nullptr;
 
 	fastBump.capacity = fastBumpSize;
 	fastBump.available = fastBumpSize;
+	fastBump.committed = fastBumpSize;
 	fastBump.memory = fastBumpMemory;
 	fastBump.lastAlloc = nullptr;
 
@@ -195,12 +322,131 @@ bool MemoryArena::init( u64 permanentSize, u64 transientSize, u64 fastBumpSize,
 	return true;
 }
 
+// Each block is only reserved, pages are committed as the allocators reach them. Nothing
+// needs clearing since fresh pages are zero, and the reserve can be far bigger than what is used
+bool MemoryArena::init_virtual( u64 permanentReserve, u64 transientReserve, u64 fastBumpReserve, u64 inHighWater )
+{
+	if ( flags & MEMORY_FLAG_INITIALISED )
+		free();
+
+	Allocator *allocators[] = { &permanent, &transient, &fastBump };
+	u64 reserves[] = { permanentReserve, transientReserve, fastBumpReserve };
+
+	for ( u64 i = 0; i < ARRAY_LENGTH( allocators ); ++i )
+	{
+		Allocator *allocator = allocators[ i ];
+		u64 reserve = ( reserves[ i ] + MEMORY_COMMIT_GRANULARITY - 1 ) & ~( MEMORY_COMMIT_GRANULARITY - 1 );
+
+		if ( reserve == 0 )
+			reserve = MEMORY_COMMIT_GRANULARITY;
+
+		allocator->memory = platform_memory_reserve( reserve );
+
+		if ( !allocator->memory )
+		{
+			for ( u64 j = 0; j < i; ++j )
+				platform_memory_release( allocators[ j ]->memory, allocators[ j ]->capacity );
+
+			return false;
+		}
+
+		allocator->flags |= ALLOCATOR_FLAG_VIRTUAL_MEMORY;
+		allocator->capacity = reserve;
+		allocator->available = reserve;
+		allocator->committed = 0;
+		allocator->lastAlloc = nullptr;
+	}
+
+	memory = permanent.memory;
+	highWater = inHighWater;
+	flags |= MEMORY_FLAG_INITIALISED | MEMORY_FLAG_VIRTUAL_MEMORY;
+	flags &= ~MEMORY_FLAG_SEPARATE_ALLOCATIONS;
+
+	return true;
+}
+
+// Files are read into and stripped out of the transient block, so that is what goes on huge pages.
+// Only while nothing is allocated from it. If they can't be had it stays as it was and this is false
+bool MemoryArena::use_huge_pages()
+{
+	if ( transient.flags & ALLOCATOR_FLAG_HUGE_PAGES )
+		return true;
+
+	if ( !( flags & MEMORY_FLAG_VIRTUAL_MEMORY ) || transient.available != transient.capacity )
+		return false;
+
+	u64 hugePageSize = platform_memory_huge_page_size();
+
+	if ( !hugePageSize )
+		return false;
+
+	u64 reserve = ( transient.capacity + hugePageSize - 1 ) & ~( hugePageSize - 1 );
+	u8 *huge = platform_memory_reserve_huge( reserve );
+
+	if ( !huge )
+		return false;
+
+	platform_memory_release( transient.memory, transient.capacity );
+
+	transient.flags |= ALLOCATOR_FLAG_HUGE_PAGES;
+	transient.memory = huge;
+	transient.capacity = reserve;
+	transient.available = reserve;
+	transient.committed = 0;
+	transient.lastAlloc = nullptr;
+	transient.epoch = memory_next_epoch();
+
+	return true;
+}
+
+// Blocks freed in any order are used again, for buffers that outlive a reset or are given back out
+// of order. Sizes are rounded up to a power of two and blocks are never split or merged
+bool MemoryArena::init_pool( u64 poolReserve )
+{
+	if ( pool.memory )
+		platform_memory_release( pool.memory, pool.capacity );
+
+	u64 reserve = ( poolReserve + sizeof( MemoryPoolBins ) + MEMORY_COMMIT_GRANULARITY - 1 ) & ~( MEMORY_COMMIT_GRANULARITY - 1 );
+
+	pool.memory = platform_memory_reserve( reserve );
+
+	if ( !pool.memory )
+		return false;
+
+	pool.flags |= ALLOCATOR_FLAG_VIRTUAL_MEMORY;
+	pool.capacity = reserve;
+	pool.available = reserve;
+	pool.committed = 0;
+	pool.lastAlloc = nullptr;
+
+	// Fresh pages are zero, so every bin starts out empty
+	if ( !memory_commit( &pool, sizeof( MemoryPoolBins ) ) )
+	{
+		platform_memory_release( pool.memory, pool.capacity );
+		pool.memory = nullptr;
+		return false;
+	}
+
+	pool.available -= sizeof( MemoryPoolBins );
+
+	return true;
+}
+
 void MemoryArena::free()
 {
+	if ( pool.memory )
+		platform_memory_release( pool.memory, pool.capacity );
+
 	if ( flags & MEMORY_FLAG_INITIALISED )
 	{
 		// Check if it was a single allocation or 2 seperate ones
-		if ( flags & MEMORY_FLAG_SEPARATE_ALLOCATIONS )
+		if ( flags & MEMORY_FLAG_VIRTUAL_MEMORY )
+		{
+			platform_memory_release( permanent.memory, permanent.capacity );
+			platform_memory_release( transient.memory, transient.capacity );
+			platform_memory_release( fastBump.memory, fastBump.capacity );
+		}
+		else if ( flags & MEMORY_FLAG_SEPARATE_ALLOCATIONS )
 		{
 			::free( permanent.memory );
 			::free( transient.memory );
@@ -217,11 +463,98 @@ void MemoryArena::free()
 
 void MemoryArena::update()
 {
+	trace_begin( "arena reset" );
+
 	transient.available = transient.capacity;
 	transient.lastAlloc = nullptr;
+	transient.epoch = memory_next_epoch();
 
 	fastBump.available = fastBump.capacity;
 	fastBump.lastAlloc = nullptr;
+	fastBump.epoch = memory_next_epoch();
+
+	// A big frame shouldn't keep its pages for the rest of the run
+	if ( flags & MEMORY_FLAG_VIRTUAL_MEMORY )
+	{
+		memory_decommit( &transient, highWater );
+		memory_decommit( &fastBump, highWater );
+	}
+
+	trace_end( "arena reset" );
+}
+
+// Whatever is already in use counts towards the peak, the rest starts from here
+void MemoryArena::enable_stats()
+{
+	Allocator *allocators[] = { &permanent, &transient, &fastBump, &pool };
+
+	for ( Allocator *allocator : allocators )
+	{
+		allocator->flags |= ALLOCATOR_FLAG_STATS;
+		allocator->stats = {};
+		allocator->stats.peak = allocator->capacity - allocator->available;
+	}
+
+	// A pool's peak is the blocks in use, its bins aren't counted
+	if ( pool.memory )
+		pool.stats.peak = reinterpret_cast<MemoryPoolBins *>( pool.memory )->inUse;
+}
+
+// VIRTUAL MEMORY ////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// A huge page is only used for a range that is committed all the way through when it is first touched
+static inline u64 memory_commit_granularity( const Allocator *allocator )
+{
+	if ( allocator->flags & ALLOCATOR_FLAG_HUGE_PAGES )
+		return platform_memory_huge_page_size();
+
+	return MEMORY_COMMIT_GRANULARITY;
+}
+
+[[nodiscard]] bool memory_commit( Allocator *allocator, u64 used )
+{
+	// Always true for allocators that aren't virtual, they are committed up to their capacity
+	if ( used <= allocator->committed )
+		return true;
+
+	u64 granularity = memory_commit_granularity( allocator );
+	u64 commit = ( used + granularity - 1 ) & ~( granularity - 1 );
+	if ( commit > allocator->capacity )
+		commit = allocator->capacity;
+
+	if ( !platform_memory_commit( allocator->memory + allocator->committed, commit - allocator->committed ) )
+		return false;
+
+	allocator->committed = commit;
+
+	return true;
+}
+
+void memory_decommit( Allocator *allocator, u64 keep )
+{
+	u64 granularity = memory_commit_granularity( allocator );
+	keep = ( keep + granularity - 1 ) & ~( granularity - 1 );
+
+	// Pages in use are never given back
+	u64 used = allocator->capacity - allocator->available;
+	if ( keep < used )
+		keep = ( used + granularity - 1 ) & ~( granularity - 1 );
+
+	if ( !( allocator->flags & ALLOCATOR_FLAG_VIRTUAL_MEMORY ) || allocator->committed <= keep )
+		return;
+
+	platform_memory_decommit( allocator->memory + keep, allocator->committed - keep );
+	allocator->committed = keep;
+}
+
+static inline void memory_stats_allocated( Allocator *allocator, u64 size, u64 padding, u64 header )
+{
+	AllocatorStats *stats = &allocator->stats;
+	stats->allocations += 1;
+	stats->bytes += size;
+	stats->padding += padding;
+	stats->headers += header;
+	stats->peak = max( stats->peak, allocator->capacity - allocator->available );
 }
 
 // BUMP ALLOCATOR ////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -229,8 +562,12 @@ void MemoryArena::update()
 {
 	assert( size );
 
+	// The header sits right before the data, so the data is never aligned to less than it
+	if ( alignment < alignof( MemoryHeader ) )
+		alignment = alignof( MemoryHeader );
+
 	u8 *p = allocator->memory + ( allocator->capacity - allocator->available ) + sizeof( MemoryHeader );
-	u64 padding = alignment - ( reinterpret_cast<u64>( p ) & ( alignment - 1 ) );
+	u64 padding = ( alignment - ( reinterpret_cast<u64>( p ) & ( alignment - 1 ) ) ) & ( alignment - 1 );
 
 	// P now points to the data
 	p += padding;
@@ -238,8 +575,11 @@ void MemoryArena::update()
 	// Total size that needs allocating
 	u64 reqSize = padding + sizeof( MemoryHeader ) + size;
 
-	if ( reqSize > allocator->available )
+	if ( reqSize > allocator->available || !memory_commit( allocator, allocator->capacity - allocator->available + reqSize ) )
 	{
+		if ( allocator->flags & ALLOCATOR_FLAG_STATS )
+			allocator->stats.failed += 1;
+
 		return nullptr;
 	}
 
@@ -254,6 +594,9 @@ void MemoryArena::update()
 	allocator->available -= reqSize;
 	allocator->lastAlloc = p;
 
+	if ( allocator->flags & ALLOCATOR_FLAG_STATS )
+		memory_stats_allocated( allocator, size, padding, sizeof( MemoryHeader ) );
+
 	if ( clearZero )
 		memset( allocator->lastAlloc, 0, size );
 
@@ -292,8 +635,11 @@ void MemoryArena::update()
 
 		u64 extraReqSizeNeeded = ( reqSize - oldReqSize );
 
-		if ( extraReqSizeNeeded > allocator->available )
+		if ( extraReqSizeNeeded > allocator->available || !memory_commit( allocator, allocator->capacity - allocator->available + extraReqSizeNeeded ) )
 		{
+			if ( allocator->flags & ALLOCATOR_FLAG_STATS )
+				allocator->stats.failed += 1;
+
 			return nullptr;
 		}
 
@@ -303,6 +649,12 @@ void MemoryArena::update()
 		// Remove the extra space required for this reallocation
 		allocator->available -= extraReqSizeNeeded;
 
+		if ( allocator->flags & ALLOCATOR_FLAG_STATS )
+		{
+			allocator->stats.bytes += size - oldSize;
+			allocator->stats.peak = max( allocator->stats.peak, allocator->capacity - allocator->available );
+		}
+
 		return static_cast<u8 *>( p );
 	}
 
@@ -364,6 +716,10 @@ void memory_bump_free( Allocator *allocator, void *p )
 		u64 reqSize = header->reqSize;
 		allocator->available += reqSize;
 		allocator->lastAlloc = header->prev;
+
+		if ( allocator->flags & ALLOCATOR_FLAG_STATS )
+			allocator->stats.frees += 1;
+
 		return;
 	}
 
@@ -375,6 +731,8 @@ void memory_bump_free( Allocator *allocator, void *p )
 		u64 reqSize = header->reqSize;
 		allocator->available += reqSize;
 		allocator->lastAlloc = header->prev;
+		if ( allocator->flags & ALLOCATOR_FLAG_STATS )
+			allocator->stats.frees += 1;
 		if ( header->attachedTo )
 			until = ( until <= header->attachedTo ? until : header->attachedTo );
 		p = header->prev;
@@ -398,7 +756,7 @@ void memory_bump_attach( Allocator *allocator, void *p, void *to )
 	assert( size );
 
 	u8 *p = allocator->memory + ( allocator->capacity - allocator->available );
-	u64 padding = alignment - ( reinterpret_cast<u64>( p ) & ( alignment - 1 ) );
+	u64 padding = ( alignment - ( reinterpret_cast<u64>( p ) & ( alignment - 1 ) ) ) & ( alignment - 1 );
 
 	// P now points to the data
 	p += padding;
@@ -406,20 +764,383 @@ void memory_bump_attach( Allocator *allocator, void *p, void *to )
 	// Total size that needs allocating
 	u64 reqSize = padding + size;
 
-	if ( reqSize > allocator->available )
+	if ( reqSize > allocator->available || !memory_commit( allocator, allocator->capacity - allocator->available + reqSize ) )
 	{
+		if ( allocator->flags & ALLOCATOR_FLAG_STATS )
+			allocator->stats.failed += 1;
+
 		return nullptr;
 	}
 
 	allocator->available -= reqSize;
 	allocator->lastAlloc = p;
 
+	if ( allocator->flags & ALLOCATOR_FLAG_STATS )
+		memory_stats_allocated( allocator, size, padding, 0 );
+
 	if ( clearZero )
 		memset( allocator->lastAlloc, 0, size );
 
 	return allocator->lastAlloc;
 }
 
+// POOL ALLOCATOR ////////////////////////////////////////////////////////////////////////////////////////////////////
+static inline u32 memory_pool_bin( u64 size )
+{
+	if ( size <= MEMORY_POOL_MIN_BLOCK )
+		return 0;
+
+	// One past the highest bit, so sizes that are exactly a block land in it
+	u64 blocks = ( size - 1 ) / MEMORY_POOL_MIN_BLOCK;
+
+	#if defined( _MSC_VER )
+		unsigned long index;
+		_BitScanReverse64( &index, blocks );
+		return static_cast<u32>( index + 1 );
+	#else
+		return static_cast<u32>( 64 - __builtin_clzll( blocks ) );
+	#endif
+}
+
+[[nodiscard]] u8 *memory_pool_allocate( Allocator *allocator, u64 size, bool clearZero, u16 alignment )
+{
+	assert( size );
+
+	MemoryPoolBins *bins = reinterpret_cast<MemoryPoolBins *>( allocator->memory );
+
+	// Blocks start 16 byte aligned, anything more is paid for up front so any block of the bin fits
+	if ( alignment < sizeof( MemoryPoolHeader ) )
+		alignment = sizeof( MemoryPoolHeader );
+
+	u64 reqSize = sizeof( MemoryPoolHeader ) + size + ( alignment - sizeof( MemoryPoolHeader ) );
+	u32 bin = ( size < allocator->capacity ? memory_pool_bin( reqSize ) : MEMORY_POOL_BIN_COUNT );
+
+	if ( bin >= MEMORY_POOL_BIN_COUNT )
+	{
+		if ( allocator->flags & ALLOCATOR_FLAG_STATS )
+			allocator->stats.failed += 1;
+
+		return nullptr;
+	}
+
+	u64 blockSize = MEMORY_POOL_MIN_BLOCK << bin;
+	u8 *block = bins->free[ bin ];
+
+	if ( block )
+	{
+		bins->free[ bin ] = *reinterpret_cast<u8 **>( block );
+	}
+	else
+	{
+		// Nothing to reuse, so a new block comes off the end
+		u64 used = allocator->capacity - allocator->available;
+
+		if ( blockSize > allocator->available || !memory_commit( allocator, used + blockSize ) )
+		{
+			if ( allocator->flags & ALLOCATOR_FLAG_STATS )
+				allocator->stats.failed += 1;
+
+			return nullptr;
+		}
+
+		block = allocator->memory + used;
+		allocator->available -= blockSize;
+	}
+
+	u8 *p = block + sizeof( MemoryPoolHeader );
+	p += ( alignment - ( reinterpret_cast<u64>( p ) & ( alignment - 1 ) ) ) & ( alignment - 1 );
+
+	MemoryPoolHeader *header = reinterpret_cast<MemoryPoolHeader *>( p - sizeof( MemoryPoolHeader ) );
+	header->bin = bin;
+	header->offset = static_cast<u16>( p - block );
+	header->alignment = alignment;
+	header->size = size;
+
+	bins->inUse += blockSize;
+	allocator->lastAlloc = p;
+
+	if ( allocator->flags & ALLOCATOR_FLAG_STATS )
+	{
+		AllocatorStats *stats = &allocator->stats;
+		stats->allocations += 1;
+		stats->bytes += size;
+		stats->padding += blockSize - size - sizeof( MemoryPoolHeader );
+		stats->headers += sizeof( MemoryPoolHeader );
+		stats->peak = max( stats->peak, bins->inUse );
+	}
+
+	if ( clearZero )
+		memset( p, 0, size );
+
+	return p;
+}
+
+[[nodiscard]] u8 *memory_pool_reallocate( Allocator *allocator, void *p, u64 size )
+{
+	if ( !p )
+		return allocator->allocate<u8>( size );
+
+	assert( size );
+
+	MemoryPoolHeader *header = reinterpret_cast<MemoryPoolHeader *>( static_cast<u8 *>( p ) - sizeof( MemoryPoolHeader ) );
+
+	// Still fits in its block
+	if ( size <= ( MEMORY_POOL_MIN_BLOCK << header->bin ) - header->offset )
+	{
+		if ( allocator->flags & ALLOCATOR_FLAG_STATS && size > header->size )
+			allocator->stats.bytes += size - header->size;
+
+		header->size = size;
+		return static_cast<u8 *>( p );
+	}
+
+	u8 *newMemory = allocator->allocate<u8>( size, false, header->alignment );
+
+	if ( !newMemory )
+		return nullptr;
+
+	memcpy( newMemory, p, header->size );
+
+	allocator->free( p );
+
+	return newMemory;
+}
+
+void memory_pool_shrink( Allocator *allocator, void *p, u64 size )
+{
+	(void)allocator;
+
+	assert( p );
+	assert( size );
+
+	MemoryPoolHeader *header = reinterpret_cast<MemoryPoolHeader *>( static_cast<u8 *>( p ) - sizeof( MemoryPoolHeader ) );
+
+	if ( size < header->size )
+		header->size = size;
+}
+
+void memory_pool_free( Allocator *allocator, void *p )
+{
+	if ( !p )
+		return;
+
+	MemoryPoolBins *bins = reinterpret_cast<MemoryPoolBins *>( allocator->memory );
+	MemoryPoolHeader *header = reinterpret_cast<MemoryPoolHeader *>( static_cast<u8 *>( p ) - sizeof( MemoryPoolHeader ) );
+	u32 bin = header->bin;
+	u8 *block = static_cast<u8 *>( p ) - header->offset;
+
+	*reinterpret_cast<u8 **>( block ) = bins->free[ bin ];
+	bins->free[ bin ] = block;
+	bins->inUse -= MEMORY_POOL_MIN_BLOCK << bin;
+
+	if ( allocator->lastAlloc == p )
+		allocator->lastAlloc = nullptr;
+
+	if ( allocator->flags & ALLOCATOR_FLAG_STATS )
+		allocator->stats.frees += 1;
+}
+
+// Every block is freed on its own, so there is nothing to rewind
+void memory_pool_attach( Allocator *allocator, void *p, void *to )
+{
+	(void)allocator;
+	(void)p;
+	(void)to;
+}
+
+// CONCURRENT ALLOCATOR //////////////////////////////////////////////////////////////////////////////////////////////
+
+// The block the thread is carving small allocations from, good for one allocator at a time
+struct MemoryConcurrentBlock
+{
+	Allocator *allocator;
+	u64 epoch;
+	u8 *cursor;
+	u8 *end;
+};
+
+static thread_local MemoryConcurrentBlock memoryConcurrentBlock = {};
+
+void memory_concurrent_init( Allocator *allocator )
+{
+	allocator->lastAlloc = nullptr;
+	allocator->epoch = memory_next_epoch();
+	allocator->allocate_func = memory_concurrent_allocate;
+	allocator->reallocate_func = memory_concurrent_reallocate;
+	allocator->shrink_func = memory_concurrent_shrink;
+	allocator->free_func = memory_concurrent_free;
+	allocator->attach_func = memory_concurrent_attach;
+}
+
+// Two threads committing the same pages is harmless, they are only ever made readable and writable here
+static bool memory_concurrent_commit( Allocator *allocator, u64 used )
+{
+	std::atomic_ref<u64> committed( allocator->committed );
+	u64 current = committed.load( std::memory_order_acquire );
+
+	if ( used <= current )
+		return true;
+
+	u64 granularity = memory_commit_granularity( allocator );
+	u64 commit = ( used + granularity - 1 ) & ~( granularity - 1 );
+	if ( commit > allocator->capacity )
+		commit = allocator->capacity;
+
+	if ( !platform_memory_commit( allocator->memory + current, commit - current ) )
+		return false;
+
+	while ( current < commit && !committed.compare_exchange_weak( current, commit, std::memory_order_release, std::memory_order_acquire ) )
+		;
+
+	return true;
+}
+
+// Space is taken with a compare and swap rather than a plain subtract, so a request that doesn't
+// fit leaves the rest for smaller ones and available never wraps
+static u8 *memory_concurrent_reserve( Allocator *allocator, u64 size )
+{
+	std::atomic_ref<u64> available( allocator->available );
+	u64 left = available.load( std::memory_order_relaxed );
+
+	do
+	{
+		if ( size > left )
+			return nullptr;
+	} while ( !available.compare_exchange_weak( left, left - size, std::memory_order_relaxed ) );
+
+	u64 used = allocator->capacity - left + size;
+
+	if ( !memory_concurrent_commit( allocator, used ) )
+		return nullptr;
+
+	if ( allocator->flags & ALLOCATOR_FLAG_STATS )
+	{
+		std::atomic_ref<u64> peak( allocator->stats.peak );
+		u64 current = peak.load( std::memory_order_relaxed );
+
+		while ( current < used && !peak.compare_exchange_weak( current, used, std::memory_order_relaxed ) )
+			;
+	}
+
+	return allocator->memory + used - size;
+}
+
+[[nodiscard]] u8 *memory_concurrent_allocate( Allocator *allocator, u64 size, bool clearZero, u16 alignment )
+{
+	assert( size );
+
+	if ( alignment < alignof( MemoryConcurrentHeader ) )
+		alignment = alignof( MemoryConcurrentHeader );
+
+	// Every size is a multiple of 8, so that is all the alignment a start is sure to have
+	u64 reqSize = ( sizeof( MemoryConcurrentHeader ) + size + ( alignment - alignof( MemoryConcurrentHeader ) ) + 7 ) & ~7ull;
+	u8 *start = nullptr;
+
+	if ( reqSize <= MEMORY_CONCURRENT_SMALL )
+	{
+		MemoryConcurrentBlock *block = &memoryConcurrentBlock;
+
+		if ( block->allocator != allocator || block->epoch != allocator->epoch || static_cast<u64>( block->end - block->cursor ) < reqSize )
+		{
+			u8 *refill = memory_concurrent_reserve( allocator, MEMORY_CONCURRENT_BLOCK );
+
+			if ( refill )
+				*block = { allocator, allocator->epoch, refill, refill + MEMORY_CONCURRENT_BLOCK };
+		}
+
+		if ( block->allocator == allocator && block->epoch == allocator->epoch && static_cast<u64>( block->end - block->cursor ) >= reqSize )
+		{
+			start = block->cursor;
+			block->cursor += reqSize;
+		}
+	}
+
+	// Big ones, and small ones once there isn't a whole block left
+	if ( !start )
+		start = memory_concurrent_reserve( allocator, reqSize );
+
+	if ( !start )
+	{
+		if ( allocator->flags & ALLOCATOR_FLAG_STATS )
+			std::atomic_ref<u64>( allocator->stats.failed ).fetch_add( 1, std::memory_order_relaxed );
+
+		return nullptr;
+	}
+
+	u8 *p = start + sizeof( MemoryConcurrentHeader );
+	p += ( alignment - ( reinterpret_cast<u64>( p ) & ( alignment - 1 ) ) ) & ( alignment - 1 );
+
+	MemoryConcurrentHeader *header = reinterpret_cast<MemoryConcurrentHeader *>( p - sizeof( MemoryConcurrentHeader ) );
+	header->size = size;
+	header->alignment = alignment;
+
+	if ( allocator->flags & ALLOCATOR_FLAG_STATS )
+	{
+		AllocatorStats *stats = &allocator->stats;
+		std::atomic_ref<u64>( stats->allocations ).fetch_add( 1, std::memory_order_relaxed );
+		std::atomic_ref<u64>( stats->bytes ).fetch_add( size, std::memory_order_relaxed );
+		std::atomic_ref<u64>( stats->padding ).fetch_add( reqSize - size - sizeof( MemoryConcurrentHeader ), std::memory_order_relaxed );
+		std::atomic_ref<u64>( stats->headers ).fetch_add( sizeof( MemoryConcurrentHeader ), std::memory_order_relaxed );
+	}
+
+	if ( clearZero )
+		memset( p, 0, size );
+
+	return p;
+}
+
+[[nodiscard]] u8 *memory_concurrent_reallocate( Allocator *allocator, void *p, u64 size )
+{
+	if ( !p )
+		return allocator->allocate<u8>( size );
+
+	assert( size );
+
+	MemoryConcurrentHeader *header = reinterpret_cast<MemoryConcurrentHeader *>( static_cast<u8 *>( p ) - sizeof( MemoryConcurrentHeader ) );
+
+	if ( size <= header->size )
+	{
+		header->size = size;
+		return static_cast<u8 *>( p );
+	}
+
+	u8 *newMemory = allocator->allocate<u8>( size, false, static_cast<u16>( header->alignment ) );
+
+	if ( !newMemory )
+		return nullptr;
+
+	memcpy( newMemory, p, header->size );
+
+	return newMemory;
+}
+
+void memory_concurrent_shrink( Allocator *allocator, void *p, u64 size )
+{
+	(void)allocator;
+
+	assert( p );
+	assert( size );
+
+	MemoryConcurrentHeader *header = reinterpret_cast<MemoryConcurrentHeader *>( static_cast<u8 *>( p ) - sizeof( MemoryConcurrentHeader ) );
+
+	if ( size < header->size )
+		header->size = size;
+}
+
+// Another thread may have allocated after it, so nothing comes back until the arena is reset
+void memory_concurrent_free( Allocator *allocator, void *p )
+{
+	(void)allocator;
+	(void)p;
+}
+
+void memory_concurrent_attach( Allocator *allocator, void *p, void *to )
+{
+	(void)allocator;
+	(void)p;
+	(void)to;
+}
+
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 [[nodiscard]] MemoryArena memory_default()
@@ -432,39 +1153,64 @@ void memory_bump_attach( Allocator *allocator, void *p, void *to )
 			.flags = 0,
 			.capacity = 0,
 			.available = 0,
+			.committed = 0,
 			.memory = nullptr,
 			.lastAlloc = nullptr,
+			.epoch = 0,
 			.allocate_func = memory_bump_allocate,
 			.reallocate_func = memory_bump_reallocate,
 			.shrink_func = memory_bump_shrink,
 			.free_func = memory_bump_free,
 			.attach_func = memory_bump_attach,
+			.stats = {},
 		},
 		.transient =
 		{
 			.flags = ALLOCATOR_FLAG_VOLATILE_MEMORY,
 			.capacity = 0,
 			.available = 0,
+			.committed = 0,
 			.memory = nullptr,
 			.lastAlloc = nullptr,
+			.epoch = 0,
 			.allocate_func = memory_bump_allocate,
 			.reallocate_func = memory_bump_reallocate,
 			.shrink_func = memory_bump_shrink,
 			.free_func = memory_bump_free,
 			.attach_func = memory_bump_attach,
+			.stats = {},
 		},
 		.fastBump =
 		{
 			.flags = ALLOCATOR_FLAG_VOLATILE_MEMORY,
 			.capacity = 0,
 			.available = 0,
+			.committed = 0,
 			.memory = nullptr,
 			.lastAlloc = nullptr,
+			.epoch = 0,
 			.allocate_func = memory_fast_bump_allocate,
 			.reallocate_func = nullptr,
 			.shrink_func = nullptr,
 			.free_func = nullptr,
 			.attach_func = nullptr,
+			.stats = {},
+		},
+		.pool =
+		{
+			.flags = 0,
+			.capacity = 0,
+			.available = 0,
+			.committed = 0,
+			.memory = nullptr,
+			.lastAlloc = nullptr,
+			.epoch = 0,
+			.allocate_func = memory_pool_allocate,
+			.reallocate_func = memory_pool_reallocate,
+			.shrink_func = memory_pool_shrink,
+			.free_func = memory_pool_free,
+			.attach_func = memory_pool_attach,
+			.stats = {},
 		},
 	};
 }
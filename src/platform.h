@@ -14,6 +14,41 @@ struct Platform
 	Xoshiro256plus xoshiro256plus;
 };
 
+// A read only view of a file, there is always a null terminator at data[ size ]
+struct MappedFile
+{
+	u8 *data;
+	u64 size;
+	u64 mappedSize;
+};
+
 bool platform_init( MemoryArena *memory );
 u64 platform_get_seed();
-void platform_delay( i32 msWait );
\ No newline at end of file
+void platform_delay( i32 msWait );
+[[nodiscard]] u64 platform_get_tick_counter();
+[[nodiscard]] u64 platform_get_tick_frequency();
+[[nodiscard]] bool platform_cpu_supports_avx2();
+[[nodiscard]] bool map_file( const char *path, MappedFile *file );
+void unmap_file( MappedFile *file );
+
+// Threads, the handle is 0 if the thread couldn't be started
+using PlatformThreadFunc = void ( * )( void *user );
+
+[[nodiscard]] u32 platform_processor_count();
+[[nodiscard]] u64 platform_thread_create( PlatformThreadFunc func, void *user );
+void platform_thread_join( u64 thread );
+
+// Virtual memory, a reserved range has no backing until it is committed.
+// Committed pages read as zero, including after being decommitted and committed again
+[[nodiscard]] u64 platform_memory_page_size();
+[[nodiscard]] u8 *platform_memory_reserve( u64 size );
+[[nodiscard]] bool platform_memory_commit( u8 *p, u64 size );
+void platform_memory_decommit( u8 *p, u64 size );
+void platform_memory_release( u8 *p, u64 size );
+
+// Huge pages, for ranges that big reads and writes stream through. The size is 0 when the system
+// won't give them. A huge reservation is aligned to that size, and how much of a range actually
+// got them is only known once its pages have been touched
+[[nodiscard]] u64 platform_memory_huge_page_size();
+[[nodiscard]] u8 *platform_memory_reserve_huge( u64 size );
+[[nodiscard]] u64 platform_memory_huge_bytes( const u8 *p, u64 size );
\ No newline at end of file
@@ -0,0 +1,313 @@
+#ifdef __PLATFORM_LINUX__
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+static u64 platform_get_nanoseconds()
+{
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC_RAW, &ts );
+	return static_cast<u64>( ts.tv_sec ) * 1000000000ull + ts.tv_nsec;
+}
+
+// Measures the tsc against the monotonic clock, only done on first use
+// so runs that never ask for the frequency don't pay for the wait
+static u64 platform_calibrate_tick_frequency()
+{
+	constexpr const u64 calibrationNanoseconds = 5000000;
+
+	u64 startNanoseconds = platform_get_nanoseconds();
+	u64 startTicks = __rdtsc();
+	u64 nanoseconds;
+
+	do
+	{
+		nanoseconds = platform_get_nanoseconds() - startNanoseconds;
+	} while ( nanoseconds < calibrationNanoseconds );
+
+	u64 ticks = __rdtsc() - startTicks;
+
+	return static_cast<u64>( static_cast<f64>( ticks ) * 1000000000.0 / static_cast<f64>( nanoseconds ) );
+}
+
+struct PlatformThreadStart
+{
+	PlatformThreadFunc func;
+	void *user;
+};
+
+static void *platform_thread_start( void *user )
+{
+	PlatformThreadStart start = *static_cast<PlatformThreadStart *>( user );
+	::free( user );
+	start.func( start.user );
+	return nullptr;
+}
+
+bool platform_init( MemoryArena *inMemory )
+{
+	platform = inMemory->permanent.allocate<Platform>( 1, true );
+	platform->memory = *inMemory;
+	memory = &platform->memory;
+	platform->startCycles = __rdtsc();
+	platform->cycleFrequency = 0;
+	return true;
+}
+
+void platform_delay( i32 msWait )
+{
+	usleep( static_cast<useconds_t>( msWait ) * 1000 );
+}
+
+u64 platform_get_seed()
+{
+	return time( nullptr ) + __rdtsc();
+}
+
+u64 platform_get_tick_counter()
+{
+	return __rdtsc();
+}
+
+u64 platform_get_tick_frequency()
+{
+	if ( platform->cycleFrequency == 0 )
+		platform->cycleFrequency = platform_calibrate_tick_frequency();
+
+	return platform->cycleFrequency;
+}
+
+bool platform_cpu_supports_avx2()
+{
+	return __builtin_cpu_supports( "avx2" ) && __builtin_cpu_supports( "bmi" );
+}
+
+bool map_file( const char *path, MappedFile *file )
+{
+	*file = {};
+
+	i32 fd = open( path, O_RDONLY | O_CLOEXEC );
+
+	if ( fd < 0 )
+	{
+		log_warning( "Failed to open file: \"%s\"", path );
+		return false;
+	}
+
+	struct stat st;
+
+	if ( fstat( fd, &st ) != 0 || st.st_size == 0 )
+	{
+		close( fd );
+		log_warning( "File \"%s\" totally empty or unreadable", path );
+		return false;
+	}
+
+	u64 size = static_cast<u64>( st.st_size );
+	u64 pageSize = static_cast<u64>( sysconf( _SC_PAGESIZE ) );
+
+	// Reserve at least one byte past the file. The file is mapped over the front of an
+	// anonymous zero mapping, so there is always a null terminator after the data
+	u64 mappedSize = ( size + pageSize ) & ~( pageSize - 1 );
+
+	void *base = mmap( nullptr, mappedSize, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+
+	if ( base == MAP_FAILED )
+	{
+		close( fd );
+		log_warning( "Failed to reserve %" PRIu64 " bytes for: \"%s\"", mappedSize, path );
+		return false;
+	}
+
+	void *data = mmap( base, size, PROT_READ, MAP_PRIVATE | MAP_FIXED | MAP_POPULATE, fd, 0 );
+
+	close( fd );
+
+	if ( data == MAP_FAILED )
+	{
+		munmap( base, mappedSize );
+		log_warning( "Failed to map file: \"%s\"", path );
+		return false;
+	}
+
+	madvise( data, size, MADV_SEQUENTIAL );
+
+	file->data = static_cast<u8 *>( data );
+	file->size = size;
+	file->mappedSize = mappedSize;
+
+	return true;
+}
+
+void unmap_file( MappedFile *file )
+{
+	if ( file->data )
+		munmap( file->data, file->mappedSize );
+
+	*file = {};
+}
+
+u64 platform_memory_page_size()
+{
+	return static_cast<u64>( sysconf( _SC_PAGESIZE ) );
+}
+
+u8 *platform_memory_reserve( u64 size )
+{
+	void *p = mmap( nullptr, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0 );
+	return p == MAP_FAILED ? nullptr : static_cast<u8 *>( p );
+}
+
+bool platform_memory_commit( u8 *p, u64 size )
+{
+	return mprotect( p, size, PROT_READ | PROT_WRITE ) == 0;
+}
+
+void platform_memory_decommit( u8 *p, u64 size )
+{
+	// Drops the pages, so they come back zeroed if committed again
+	madvise( p, size, MADV_DONTNEED );
+	mprotect( p, size, PROT_NONE );
+}
+
+void platform_memory_release( u8 *p, u64 size )
+{
+	munmap( p, size );
+}
+
+// Transparent huge pages, asked for with madvise. MAP_HUGETLB needs pages set aside up front and
+// a fault with none left is a SIGBUS, so there would be nothing to fall back to
+u64 platform_memory_huge_page_size()
+{
+	static std::atomic<u64> hugePageSize = UINT64_MAX;
+	u64 size = hugePageSize.load( std::memory_order_relaxed );
+
+	if ( size != UINT64_MAX )
+		return size;
+
+	size = 0;
+	char text[ 64 ] = "";
+
+	FILE *enabled = fopen( "/sys/kernel/mm/transparent_hugepage/enabled", "r" );
+	if ( enabled )
+	{
+		if ( fgets( text, sizeof( text ), enabled ) && !strstr( text, "[never]" ) )
+			size = MB( 2 );
+
+		fclose( enabled );
+	}
+
+	FILE *pmdSize = ( size ? fopen( "/sys/kernel/mm/transparent_hugepage/hpage_pmd_size", "r" ) : nullptr );
+	if ( pmdSize )
+	{
+		unsigned long long bytes = 0;
+
+		if ( fscanf( pmdSize, "%llu", &bytes ) == 1 && bytes > 0 && ( bytes & ( bytes - 1 ) ) == 0 )
+			size = bytes;
+
+		fclose( pmdSize );
+	}
+
+	hugePageSize.store( size, std::memory_order_relaxed );
+
+	return size;
+}
+
+u8 *platform_memory_reserve_huge( u64 size )
+{
+	u64 hugePageSize = platform_memory_huge_page_size();
+
+	if ( !hugePageSize || ( size & ( hugePageSize - 1 ) ) )
+		return nullptr;
+
+	// A huge page more than needed, so an aligned range fits and the rest is given back
+	u64 span = size + hugePageSize;
+	void *reserved = mmap( nullptr, span, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0 );
+
+	if ( reserved == MAP_FAILED )
+		return nullptr;
+
+	u8 *start = static_cast<u8 *>( reserved );
+	u8 *p = reinterpret_cast<u8 *>( ( reinterpret_cast<u64>( start ) + hugePageSize - 1 ) & ~( hugePageSize - 1 ) );
+
+	if ( p > start )
+		munmap( start, p - start );
+
+	if ( start + span > p + size )
+		munmap( p + size, ( start + span ) - ( p + size ) );
+
+	if ( madvise( p, size, MADV_HUGEPAGE ) != 0 )
+	{
+		munmap( p, size );
+		return nullptr;
+	}
+
+	return p;
+}
+
+u64 platform_memory_huge_bytes( const u8 *p, u64 size )
+{
+	FILE *smaps = fopen( "/proc/self/smaps", "r" );
+
+	if ( !smaps )
+		return 0;
+
+	u64 begin = reinterpret_cast<u64>( p );
+	u64 end = begin + size;
+	u64 bytes = 0;
+	bool inside = false;
+	char line[ 512 ];
+
+	// Each mapping is a line with its range, then a line for each of its counts
+	while ( fgets( line, sizeof( line ), smaps ) )
+	{
+		unsigned long long from, to, kb;
+
+		if ( sscanf( line, "%llx-%llx ", &from, &to ) == 2 )
+			inside = ( from >= begin && to <= end );
+		else if ( inside && sscanf( line, "AnonHugePages: %llu kB", &kb ) == 1 )
+			bytes += KB( kb );
+	}
+
+	fclose( smaps );
+
+	return bytes;
+}
+
+u32 platform_processor_count()
+{
+	long count = sysconf( _SC_NPROCESSORS_ONLN );
+	return count > 0 ? static_cast<u32>( count ) : 1;
+}
+
+u64 platform_thread_create( PlatformThreadFunc func, void *user )
+{
+	// Handed to the thread, which frees it once it has copied it
+	PlatformThreadStart *start = static_cast<PlatformThreadStart *>( malloc( sizeof( PlatformThreadStart ) ) );
+	if ( !start )
+		return 0;
+
+	start->func = func;
+	start->user = user;
+
+	pthread_t thread;
+
+	if ( pthread_create( &thread, nullptr, platform_thread_start, start ) != 0 )
+	{
+		::free( start );
+		return 0;
+	}
+
+	static_assert( sizeof( pthread_t ) <= sizeof( u64 ) );
+	return static_cast<u64>( thread );
+}
+
+void platform_thread_join( u64 thread )
+{
+	if ( thread )
+		pthread_join( static_cast<pthread_t>( thread ), nullptr );
+}
@@ -8,6 +8,20 @@
 #undef near
 #endif
 
+struct PlatformThreadStart
+{
+	PlatformThreadFunc func;
+	void *user;
+};
+
+static DWORD WINAPI platform_thread_start( LPVOID user )
+{
+	PlatformThreadStart start = *static_cast<PlatformThreadStart *>( user );
+	::free( user );
+	start.func( start.user );
+	return 0;
+}
+
 bool platform_init( MemoryArena *inMemory )
 {
 	platform = inMemory->permanent.allocate<Platform>( 1, true );
@@ -42,4 +56,167 @@ u64 platform_get_tick_counter()
 u64 platform_get_tick_frequency()
 {
 	return platform->cycleFrequency;
-}
\ No newline at end of file
+}
+
+bool platform_cpu_supports_avx2()
+{
+	i32 info[ 4 ];
+
+	__cpuid( info, 0 );
+	if ( info[ 0 ] < 7 )
+		return false;
+
+	// AVX and the OS saving the YMM registers
+	__cpuid( info, 1 );
+	if ( !( info[ 2 ] & BIT( 27 ) ) || !( info[ 2 ] & BIT( 28 ) ) )
+		return false;
+
+	if ( ( _xgetbv( 0 ) & 0x6 ) != 0x6 )
+		return false;
+
+	// AVX2 & BMI1
+	__cpuidex( info, 7, 0 );
+	return ( info[ 1 ] & BIT( 5 ) ) && ( info[ 1 ] & BIT( 3 ) );
+}
+
+bool map_file( const char *path, MappedFile *file )
+{
+	*file = {};
+
+	HANDLE handle = CreateFileA( path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr );
+
+	if ( handle == INVALID_HANDLE_VALUE )
+	{
+		log_warning( "Failed to open file: \"%s\"", path );
+		return false;
+	}
+
+	LARGE_INTEGER size;
+	SYSTEM_INFO info;
+	GetSystemInfo( &info );
+
+	// The view is zero filled past the end of the file up to the page, but a file that
+	// ends exactly on a page has no room for the null terminator. Those get read instead
+	if ( !GetFileSizeEx( handle, &size ) || size.QuadPart == 0 || ( size.QuadPart % info.dwPageSize ) == 0 )
+	{
+		CloseHandle( handle );
+		return false;
+	}
+
+	HANDLE mapping = CreateFileMappingA( handle, nullptr, PAGE_READONLY, 0, 0, nullptr );
+	CloseHandle( handle );
+
+	if ( !mapping )
+	{
+		log_warning( "Failed to map file: \"%s\"", path );
+		return false;
+	}
+
+	void *data = MapViewOfFile( mapping, FILE_MAP_READ, 0, 0, 0 );
+	CloseHandle( mapping );
+
+	if ( !data )
+	{
+		log_warning( "Failed to map file: \"%s\"", path );
+		return false;
+	}
+
+	file->data = static_cast<u8 *>( data );
+	file->size = size.QuadPart;
+	file->mappedSize = size.QuadPart;
+
+	return true;
+}
+
+void unmap_file( MappedFile *file )
+{
+	if ( file->data )
+		UnmapViewOfFile( file->data );
+
+	*file = {};
+}
+u64 platform_memory_page_size()
+{
+	SYSTEM_INFO info;
+	GetSystemInfo( &info );
+	return info.dwPageSize;
+}
+
+u8 *platform_memory_reserve( u64 size )
+{
+	return static_cast<u8 *>( VirtualAlloc( nullptr, size, MEM_RESERVE, PAGE_NOACCESS ) );
+}
+
+bool platform_memory_commit( u8 *p, u64 size )
+{
+	return VirtualAlloc( p, size, MEM_COMMIT, PAGE_READWRITE ) != nullptr;
+}
+
+void platform_memory_decommit( u8 *p, u64 size )
+{
+	VirtualFree( p, size, MEM_DECOMMIT );
+}
+
+void platform_memory_release( u8 *p, u64 size )
+{
+	(void)size;
+	VirtualFree( p, 0, MEM_RELEASE );
+}
+
+// Large pages need SeLockMemoryPrivilege and are committed when they are reserved, which doesn't
+// fit arenas that commit as they grow, so they are never used
+u64 platform_memory_huge_page_size()
+{
+	return 0;
+}
+
+u8 *platform_memory_reserve_huge( u64 size )
+{
+	(void)size;
+	return nullptr;
+}
+
+u64 platform_memory_huge_bytes( const u8 *p, u64 size )
+{
+	(void)p;
+	(void)size;
+	return 0;
+}
+
+u32 platform_processor_count()
+{
+	SYSTEM_INFO info;
+	GetSystemInfo( &info );
+	return info.dwNumberOfProcessors > 0 ? info.dwNumberOfProcessors : 1;
+}
+
+u64 platform_thread_create( PlatformThreadFunc func, void *user )
+{
+	// Handed to the thread, which frees it once it has copied it
+	PlatformThreadStart *start = static_cast<PlatformThreadStart *>( malloc( sizeof( PlatformThreadStart ) ) );
+	if ( !start )
+		return 0;
+
+	start->func = func;
+	start->user = user;
+
+	HANDLE thread = CreateThread( nullptr, 0, platform_thread_start, start, 0, nullptr );
+
+	if ( !thread )
+	{
+		::free( start );
+		return 0;
+	}
+
+	return reinterpret_cast<u64>( thread );
+}
+
+void platform_thread_join( u64 thread )
+{
+	if ( !thread )
+		return;
+
+	HANDLE handle = reinterpret_cast<HANDLE>( thread );
+	WaitForSingleObject( handle, INFINITE );
+	CloseHandle( handle );
+}
@@ -0,0 +1,1135 @@
+
+#ifndef _HG_STRIP_FUNCTIONS
+#define _HG_STRIP_FUNCTIONS
+
+#include <immintrin.h>
+
+#if defined( _MSC_VER )
+	#define STRIP_TARGET_AVX2
+#else
+	#define STRIP_TARGET_AVX2 __attribute__(( target( "avx2,bmi" ) ))
+#endif
+
+using StripEngine = u32;
+enum STRIP_ENGINE : StripEngine
+{
+	STRIP_ENGINE_SCALAR,				// byte at a time, the reference path
+	STRIP_ENGINE_AVX2,					// 64 byte blocks classified into bitmasks
+	STRIP_ENGINE_DFA,					// one table lookup per byte, no branches
+	STRIP_ENGINE_SKIP,					// fast-forwards to the next byte that matters in each state
+	STRIP_ENGINE_COUNT,
+};
+
+constexpr const char *STRIP_ENGINE_NAMES[ STRIP_ENGINE_COUNT ] =
+{
+	"scalar",
+	"avx2",
+	"dfa",
+	"skip",
+};
+
+using StripInput = u32;
+enum STRIP_INPUT : StripInput
+{
+	STRIP_INPUT_MAP,					// the file is mapped read only, falls back to read if it can't be
+	STRIP_INPUT_READ,					// the file is read into the transient arena
+	STRIP_INPUT_URING,					// files are read and written in batches through io_uring, falls back to read
+	STRIP_INPUT_COUNT,
+};
+
+constexpr const char *STRIP_INPUT_NAMES[ STRIP_INPUT_COUNT ] =
+{
+	"map",
+	"read",
+	"uring",
+};
+
+using StripOutput = u32;
+enum STRIP_OUTPUT : StripOutput
+{
+	STRIP_OUTPUT_IN_PLACE,				// kept bytes are compacted to the front of the read buffer
+	STRIP_OUTPUT_COPY,					// kept bytes are copied to a second buffer
+	STRIP_OUTPUT_SPANS,					// kept spans of the read buffer are written with vectored writes
+	STRIP_OUTPUT_COUNT,
+};
+
+constexpr const char *STRIP_OUTPUT_NAMES[ STRIP_OUTPUT_COUNT ] =
+{
+	"in-place",
+	"copy",
+	"spans",
+};
+
+constexpr const u64 STRIP_SPAN_BATCH_SIZE = 1024;
+constexpr const u64 STRIP_STREAM_CHUNK_SIZE = MB( 1 );
+constexpr const u64 STRIP_PARALLEL_MIN_CHUNK_SIZE = KB( 256 );	// smaller chunks cost more to start than they save
+constexpr const u64 STRIP_SPECULATE_PREFIX = KB( 4 );			// most bytes every entry state is stepped through together
+
+// Kept spans point into the source buffer, when the batch fills it is handed to flush_func
+struct StripSpanBatch
+{
+	FileSpan *spans;
+	u64 capacity;
+	u64 count;
+	u64 bytes;
+	void *user;
+
+	bool ( *flush_func )( StripSpanBatch *batch );
+};
+
+// The escape states mean the previous byte was a backslash, so a quote is not a quote.
+// Two byte tokens are split over a pending state, the byte is not emitted until the next is seen
+using StripState = u8;
+enum STRIP_STATE : StripState
+{
+	STRIP_STATE_CODE,
+	STRIP_STATE_CODE_ESCAPE,
+	STRIP_STATE_CODE_SLASH,				// pending '/', might open a comment
+	STRIP_STATE_LINE_COMMENT,
+	STRIP_STATE_BLOCK_COMMENT,
+	STRIP_STATE_BLOCK_COMMENT_STAR,		// pending '*', might close the comment
+	STRIP_STATE_STRING_LITERAL,
+	STRIP_STATE_STRING_LITERAL_ESCAPE,
+	STRIP_STATE_CHAR_LITERAL,
+	STRIP_STATE_CHAR_LITERAL_ESCAPE,
+	STRIP_STATE_END,					// null terminator reached
+	STRIP_STATE_COUNT,
+};
+
+using StripClass = u8;
+enum STRIP_CLASS : StripClass
+{
+	STRIP_CLASS_OTHER,
+	STRIP_CLASS_SLASH,
+	STRIP_CLASS_STAR,
+	STRIP_CLASS_DOUBLE_QUOTE,
+	STRIP_CLASS_SINGLE_QUOTE,
+	STRIP_CLASS_BACKSLASH,
+	STRIP_CLASS_NEWLINE,
+	STRIP_CLASS_TERMINATOR,
+	STRIP_CLASS_COUNT,
+};
+
+// Transition layout, the low bits are the next state
+constexpr const u8 STRIP_TRANSITION_STATE_MASK = 0xF;
+constexpr const u8 STRIP_TRANSITION_EMIT_SLASH_SHIFT = 4;	// emit the pending '/' first
+constexpr const u8 STRIP_TRANSITION_EMIT_BYTE_SHIFT = 5;	// emit the current byte
+
+static_assert( STRIP_STATE_COUNT <= STRIP_TRANSITION_STATE_MASK + 1 );
+
+struct StripDFA
+{
+	StripClass classes[ 256 ];
+	u8 transitions[ STRIP_STATE_COUNT ][ STRIP_CLASS_COUNT ];
+};
+
+// Every engine takes [size] bytes of source followed by a null terminator, and writes
+// the stripped output to dst, which must be able to hold size + 1 bytes.
+// dst can be src, the output never overtakes the input so it is compacted in place.
+// Returns the number of bytes written to dst.
+u64 strip_comments( StripEngine engine, const u8 *src, u64 size, u8 *dst );
+u64 strip_comments_scalar( const u8 *src, u64 size, u8 *dst );
+u64 strip_comments_avx2( const u8 *src, u64 size, u8 *dst );
+u64 strip_comments_dfa( const u8 *src, u64 size, u8 *dst );
+u64 strip_comments_skip( const u8 *src, u64 size, u8 *dst );
+
+// Same as the skip engine, but nothing is copied. Returns false if a flush failed
+bool strip_comments_spans( const u8 *src, u64 size, StripSpanBatch *batch );
+
+// Streaming, for input that doesn't fit in memory. Chunks are fed in order with the same state,
+// starting at STRIP_STATE_CODE, no terminator is needed and dst must hold size + 1 bytes.
+// A token split over a chunk boundary is held in the state, so strip_comments_chunk_end
+// must be called once after the last chunk to flush it (it writes at most one byte).
+u64 strip_comments_chunk( const u8 *src, u64 size, u8 *dst, StripState *state );
+u64 strip_comments_chunk_end( StripState state, u8 *dst );
+
+struct ThreadPool;
+
+// Splits one buffer into chunkCount chunks and strips them on their own threads. Each chunk is first
+// run from every entry state to learn where it would exit, the real entry states are then chained
+// together from the start and the chunks are stripped again for real and compacted.
+// Same contract and output as the other engines, the tables come from the allocator. Both passes
+// run on the pool, which is best started up front so a file doesn't pay for creating its threads
+u64 strip_comments_parallel( const u8 *src, u64 size, u8 *dst, u32 chunkCount, ThreadPool *pool, Allocator *allocator );
+
+// Fast-forward routines, each returns the first byte that matters in that state, or end.
+// The null terminator always matters, since the scalar loop stops at the first one
+[[nodiscard]] const u8 *strip_skip_code( const u8 *src, const u8 *end );
+[[nodiscard]] const u8 *strip_skip_line_comment( const u8 *src, const u8 *end );
+[[nodiscard]] const u8 *strip_skip_block_comment( const u8 *src, const u8 *end );
+[[nodiscard]] const u8 *strip_skip_string_literal( const u8 *src, const u8 *end );
+[[nodiscard]] const u8 *strip_skip_char_literal( const u8 *src, const u8 *end );
+
+[[nodiscard]] StripEngine strip_engine_default();
+[[nodiscard]] StripEngine strip_engine_from_name( const char *name );
+[[nodiscard]] StripInput strip_input_from_name( const char *name );
+[[nodiscard]] StripOutput strip_output_from_name( const char *name );
+
+#endif // _HG_STRIP_FUNCTIONS
+
+// --------------------------------------------------------------------------------
+
+#if defined( STRIP_FUNCTIONS_IMPLEMENTATION )
+
+u64 strip_comments( StripEngine engine, const u8 *src, u64 size, u8 *dst )
+{
+	switch ( engine )
+	{
+	case STRIP_ENGINE_AVX2:		return strip_comments_avx2( src, size, dst );
+	case STRIP_ENGINE_DFA:		return strip_comments_dfa( src, size, dst );
+	case STRIP_ENGINE_SKIP:		return strip_comments_skip( src, size, dst );
+	default:					return strip_comments_scalar( src, size, dst );
+	}
+}
+
+[[nodiscard]] StripEngine strip_engine_default()
+{
+	return platform_cpu_supports_avx2() ? STRIP_ENGINE_AVX2 : STRIP_ENGINE_SKIP;
+}
+
+[[nodiscard]] StripEngine strip_engine_from_name( const char *name )
+{
+	for ( StripEngine engine = 0; engine < STRIP_ENGINE_COUNT; ++engine )
+	{
+		if ( string_utf8_compare( name, STRIP_ENGINE_NAMES[ engine ] ) )
+			return engine;
+	}
+
+	return STRIP_ENGINE_COUNT;
+}
+
+[[nodiscard]] StripInput strip_input_from_name( const char *name )
+{
+	for ( StripInput input = 0; input < STRIP_INPUT_COUNT; ++input )
+	{
+		if ( string_utf8_compare( name, STRIP_INPUT_NAMES[ input ] ) )
+			return input;
+	}
+
+	return STRIP_INPUT_COUNT;
+}
+
+[[nodiscard]] StripOutput strip_output_from_name( const char *name )
+{
+	for ( StripOutput output = 0; output < STRIP_OUTPUT_COUNT; ++output )
+	{
+		if ( string_utf8_compare( name, STRIP_OUTPUT_NAMES[ output ] ) )
+			return output;
+	}
+
+	return STRIP_OUTPUT_COUNT;
+}
+
+// SCALAR ////////////////////////////////////////////////////////////////////////////////////////////////////////////
+u64 strip_comments_scalar( const u8 *src, u64 size, u8 *dst )
+{
+	(void)size;
+
+	u8 *dstStart = dst;
+	char l = '\0';
+	char c = *src++;
+	bool inComment = false;
+	bool blockComment = false;
+	bool inStringLiteral = false;
+	char stringLiteralOpener = '\0';
+
+	while ( c != '\0' )
+	{
+		if ( c == '/' && ( *src == '/' || *src == '*' ) && !inComment && !inStringLiteral )
+		{
+			inComment = true;
+			blockComment = ( *src == '*' );
+			src += 1;
+		}
+		else if ( c == '\n' && !blockComment )
+		{
+			inComment = false;
+		}
+		else if ( ( c == '*' && *src == '/' ) && blockComment )
+		{
+			inComment = false;
+			blockComment = false;
+			src += 1;
+		}
+		else if ( !inComment )
+		{
+			if ( l != '\\' && ( c == '"' || c == '\'' ) )
+			{
+				if ( !inStringLiteral )
+				{
+					if ( c == '"' )
+					{
+						inStringLiteral = true;
+						stringLiteralOpener = '"';
+					}
+					else if ( c == '\'' )
+					{
+						inStringLiteral = true;
+						stringLiteralOpener = '\'';
+					}
+				}
+				else
+				{
+					if ( c == '"' && stringLiteralOpener == '"' )
+					{
+						inStringLiteral = false;
+						stringLiteralOpener = '\0';
+					}
+					else if ( c == '\'' && stringLiteralOpener == '\'' )
+					{
+						inStringLiteral = false;
+						stringLiteralOpener = '\0';
+					}
+				}
+			}
+
+			*dst++ = c;
+		}
+
+		l = c;
+		c = *src++;
+	}
+
+	return dst - dstStart;
+}
+
+// AVX2 //////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Each 64 byte block is classified once into bitmasks, then the state logic only runs
+// on the positions that can change the state. Everything between them is copied
+// (code and literals) or skipped (comments) in bulk.
+//
+// Only the base states are used, the escapes come from the backslash mask and
+// the two byte tokens are resolved by looking one byte ahead.
+//
+// Matches the scalar loop exactly, including its quirks:
+//  - a quote only counts if the byte before it is not a backslash
+//  - a newline is never kept, and only ends a line comment
+//  - "/*/" does not close the comment it opens
+
+constexpr const u64 STRIP_AVX2_BLOCK_SIZE = 64;
+
+// Blocks need another block of readable memory after them for the look ahead
+// and the unaligned 64 byte copies, both for the source and the destination
+constexpr const u64 STRIP_AVX2_BLOCK_SLACK = STRIP_AVX2_BLOCK_SIZE * 2;
+
+struct StripAVX2Masks
+{
+	u64 slash;
+	u64 star;
+	u64 doubleQuote;
+	u64 singleQuote;
+	u64 backslash;
+	u64 newline;
+	u64 terminator;
+};
+
+STRIP_TARGET_AVX2 static inline u64 strip_avx2_match( __m256i lo, __m256i hi, char c )
+{
+	__m256i v = _mm256_set1_epi8( c );
+	u64 l = static_cast<u32>( _mm256_movemask_epi8( _mm256_cmpeq_epi8( lo, v ) ) );
+	u64 h = static_cast<u32>( _mm256_movemask_epi8( _mm256_cmpeq_epi8( hi, v ) ) );
+	return l | ( h << 32 );
+}
+
+STRIP_TARGET_AVX2 static inline void strip_avx2_classify( const u8 *block, StripAVX2Masks *masks )
+{
+	__m256i lo = _mm256_loadu_si256( reinterpret_cast<const __m256i *>( block ) );
+	__m256i hi = _mm256_loadu_si256( reinterpret_cast<const __m256i *>( block + 32 ) );
+	masks->slash = strip_avx2_match( lo, hi, '/' );
+	masks->star = strip_avx2_match( lo, hi, '*' );
+	masks->doubleQuote = strip_avx2_match( lo, hi, '"' );
+	masks->singleQuote = strip_avx2_match( lo, hi, '\'' );
+	masks->backslash = strip_avx2_match( lo, hi, '\\' );
+	masks->newline = strip_avx2_match( lo, hi, '\n' );
+	masks->terminator = strip_avx2_match( lo, hi, '\0' );
+}
+
+STRIP_TARGET_AVX2 static inline void strip_avx2_copy( u8 *dst, const u8 *src )
+{
+	_mm256_storeu_si256( reinterpret_cast<__m256i *>( dst ), _mm256_loadu_si256( reinterpret_cast<const __m256i *>( src ) ) );
+	_mm256_storeu_si256( reinterpret_cast<__m256i *>( dst + 32 ), _mm256_loadu_si256( reinterpret_cast<const __m256i *>( src + 32 ) ) );
+}
+
+// Processes one block starting at [pos], returns the position to continue from in the next block
+// (can be past the block size if a two byte token straddled the boundary), or UINT64_MAX once
+// the null terminator is reached
+STRIP_TARGET_AVX2 static u64 strip_avx2_block( const u8 *block, u64 pos, StripState *state, u64 *backslashCarry, u8 **pDst, bool inPlace )
+{
+	StripAVX2Masks masks;
+	strip_avx2_classify( block, &masks );
+
+	// A quote straight after a backslash is not a quote
+	u64 escaped = ( masks.backslash << 1 ) | *backslashCarry;
+	*backslashCarry = masks.backslash >> 63;
+
+	u64 doubleQuote = masks.doubleQuote & ~escaped;
+	u64 singleQuote = masks.singleQuote & ~escaped;
+
+	// The positions each state has to stop at
+	u64 interesting[ STRIP_STATE_COUNT ] = {};
+	interesting[ STRIP_STATE_CODE ] = masks.slash | doubleQuote | singleQuote | masks.newline | masks.terminator;
+	interesting[ STRIP_STATE_LINE_COMMENT ] = masks.newline | masks.terminator;
+	interesting[ STRIP_STATE_BLOCK_COMMENT ] = masks.star | masks.terminator;
+	interesting[ STRIP_STATE_STRING_LITERAL ] = doubleQuote | masks.newline | masks.terminator;
+	interesting[ STRIP_STATE_CHAR_LITERAL ] = singleQuote | masks.newline | masks.terminator;
+
+	u8 *dst = *pDst;
+	StripState s = *state;
+
+	while ( pos < STRIP_AVX2_BLOCK_SIZE )
+	{
+		u64 m = interesting[ s ] & ( ~0ull << pos );
+		u64 next = m ? _tzcnt_u64( m ) : STRIP_AVX2_BLOCK_SIZE;
+
+		// Bulk copy the run up to the next interesting byte. In place the 64 byte
+		// store is only used when it cannot reach a byte that hasn't been read yet
+		if ( s == STRIP_STATE_CODE || s == STRIP_STATE_STRING_LITERAL || s == STRIP_STATE_CHAR_LITERAL )
+		{
+			if ( !inPlace || dst == block + pos || dst + STRIP_AVX2_BLOCK_SIZE <= block + pos )
+				strip_avx2_copy( dst, block + pos );
+			else
+				memmove( dst, block + pos, next - pos );
+
+			dst += next - pos;
+		}
+
+		if ( next == STRIP_AVX2_BLOCK_SIZE )
+		{
+			pos = next;
+			break;
+		}
+
+		u8 c = block[ next ];
+		u8 n = block[ next + 1 ];
+		pos = next + 1;
+
+		if ( c == '\0' )
+		{
+			*pDst = dst;
+			*state = s;
+			return UINT64_MAX;
+		}
+
+		switch ( s )
+		{
+		case STRIP_STATE_CODE:
+			if ( c == '/' )
+			{
+				if ( n == '/' || n == '*' )
+				{
+					s = ( n == '/' ? STRIP_STATE_LINE_COMMENT : STRIP_STATE_BLOCK_COMMENT );
+					pos += 1;
+				}
+				else
+				{
+					*dst++ = c;
+				}
+			}
+			else if ( c == '"' )
+			{
+				s = STRIP_STATE_STRING_LITERAL;
+				*dst++ = c;
+			}
+			else if ( c == '\'' )
+			{
+				s = STRIP_STATE_CHAR_LITERAL;
+				*dst++ = c;
+			}
+			break;
+
+		case STRIP_STATE_LINE_COMMENT:
+			s = STRIP_STATE_CODE;
+			break;
+
+		case STRIP_STATE_BLOCK_COMMENT:
+			if ( n == '/' )
+			{
+				s = STRIP_STATE_CODE;
+				pos += 1;
+			}
+			break;
+
+		case STRIP_STATE_STRING_LITERAL:
+		case STRIP_STATE_CHAR_LITERAL:
+			if ( c != '\n' )
+			{
+				s = STRIP_STATE_CODE;
+				*dst++ = c;
+			}
+			break;
+
+		default:
+			break;
+		}
+	}
+
+	*pDst = dst;
+	*state = s;
+
+	return pos;
+}
+
+STRIP_TARGET_AVX2 u64 strip_comments_avx2( const u8 *src, u64 size, u8 *dst )
+{
+	u8 *dstStart = dst;
+	StripState state = STRIP_STATE_CODE;
+	bool inPlace = ( dst == src );
+	u64 backslashCarry = 0;
+	u64 base = 0;
+	u64 pos = 0;
+
+	// Work directly on the buffers while there is enough slack after the block
+	while ( base + STRIP_AVX2_BLOCK_SLACK <= size + 1 )
+	{
+		pos = strip_avx2_block( src + base, pos, &state, &backslashCarry, &dst, inPlace );
+		if ( pos == UINT64_MAX )
+			return dst - dstStart;
+		base += STRIP_AVX2_BLOCK_SIZE;
+		pos -= STRIP_AVX2_BLOCK_SIZE;
+	}
+
+	// The tail goes through a padded copy, the padding is all terminators.
+	// It is copied out before any of its output is written back, so in place is fine
+	alignas( 32 ) u8 tail[ STRIP_AVX2_BLOCK_SLACK + STRIP_AVX2_BLOCK_SIZE ] = {};
+	alignas( 32 ) u8 tailOut[ STRIP_AVX2_BLOCK_SLACK + STRIP_AVX2_BLOCK_SIZE ];
+	memcpy( tail, src + base, size - base );
+
+	u8 *out = tailOut;
+	u64 tailBase = 0;
+
+	while ( pos != UINT64_MAX )
+	{
+		pos = strip_avx2_block( tail + tailBase, pos, &state, &backslashCarry, &out, false );
+		tailBase += STRIP_AVX2_BLOCK_SIZE;
+		if ( pos != UINT64_MAX )
+			pos -= STRIP_AVX2_BLOCK_SIZE;
+	}
+
+	memcpy( dst, tailOut, out - tailOut );
+	dst += out - tailOut;
+
+	return dst - dstStart;
+}
+
+// DFA ///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+constexpr u8 strip_dfa_transition( StripState next, bool emitSlash, bool emitByte )
+{
+	return static_cast<u8>( next | ( emitSlash << STRIP_TRANSITION_EMIT_SLASH_SHIFT ) | ( emitByte << STRIP_TRANSITION_EMIT_BYTE_SHIFT ) );
+}
+
+constexpr u8 strip_dfa_code_transition( StripClass c, bool escaped, bool emitSlash )
+{
+	switch ( c )
+	{
+	case STRIP_CLASS_SLASH:			return strip_dfa_transition( STRIP_STATE_CODE_SLASH, emitSlash, false );
+	case STRIP_CLASS_DOUBLE_QUOTE:	return strip_dfa_transition( escaped ? STRIP_STATE_CODE : STRIP_STATE_STRING_LITERAL, emitSlash, true );
+	case STRIP_CLASS_SINGLE_QUOTE:	return strip_dfa_transition( escaped ? STRIP_STATE_CODE : STRIP_STATE_CHAR_LITERAL, emitSlash, true );
+	case STRIP_CLASS_BACKSLASH:		return strip_dfa_transition( STRIP_STATE_CODE_ESCAPE, emitSlash, true );
+	case STRIP_CLASS_NEWLINE:		return strip_dfa_transition( STRIP_STATE_CODE, emitSlash, false );
+	case STRIP_CLASS_TERMINATOR:	return strip_dfa_transition( STRIP_STATE_END, emitSlash, false );
+	default:						return strip_dfa_transition( STRIP_STATE_CODE, emitSlash, true );
+	}
+}
+
+constexpr u8 strip_dfa_literal_transition( StripClass c, StripClass quote, StripState literal, StripState literalEscape, bool escaped )
+{
+	if ( c == quote && !escaped )
+		return strip_dfa_transition( STRIP_STATE_CODE, false, true );
+
+	switch ( c )
+	{
+	case STRIP_CLASS_BACKSLASH:		return strip_dfa_transition( literalEscape, false, true );
+	case STRIP_CLASS_NEWLINE:		return strip_dfa_transition( literal, false, false );
+	case STRIP_CLASS_TERMINATOR:	return strip_dfa_transition( STRIP_STATE_END, false, false );
+	default:						return strip_dfa_transition( literal, false, true );
+	}
+}
+
+constexpr u8 strip_dfa_build_transition( StripState s, StripClass c )
+{
+	switch ( s )
+	{
+	case STRIP_STATE_CODE:
+		return strip_dfa_code_transition( c, false, false );
+
+	case STRIP_STATE_CODE_ESCAPE:
+		return strip_dfa_code_transition( c, true, false );
+
+	case STRIP_STATE_CODE_SLASH:
+		if ( c == STRIP_CLASS_SLASH )
+			return strip_dfa_transition( STRIP_STATE_LINE_COMMENT, false, false );
+		if ( c == STRIP_CLASS_STAR )
+			return strip_dfa_transition( STRIP_STATE_BLOCK_COMMENT, false, false );
+		return strip_dfa_code_transition( c, false, true );
+
+	case STRIP_STATE_LINE_COMMENT:
+		if ( c == STRIP_CLASS_NEWLINE )
+			return strip_dfa_transition( STRIP_STATE_CODE, false, false );
+		if ( c == STRIP_CLASS_TERMINATOR )
+			return strip_dfa_transition( STRIP_STATE_END, false, false );
+		return strip_dfa_transition( STRIP_STATE_LINE_COMMENT, false, false );
+
+	case STRIP_STATE_BLOCK_COMMENT:
+	case STRIP_STATE_BLOCK_COMMENT_STAR:
+		if ( c == STRIP_CLASS_SLASH && s == STRIP_STATE_BLOCK_COMMENT_STAR )
+			return strip_dfa_transition( STRIP_STATE_CODE, false, false );
+		if ( c == STRIP_CLASS_STAR )
+			return strip_dfa_transition( STRIP_STATE_BLOCK_COMMENT_STAR, false, false );
+		if ( c == STRIP_CLASS_TERMINATOR )
+			return strip_dfa_transition( STRIP_STATE_END, false, false );
+		return strip_dfa_transition( STRIP_STATE_BLOCK_COMMENT, false, false );
+
+	case STRIP_STATE_STRING_LITERAL:
+		return strip_dfa_literal_transition( c, STRIP_CLASS_DOUBLE_QUOTE, STRIP_STATE_STRING_LITERAL, STRIP_STATE_STRING_LITERAL_ESCAPE, false );
+
+	case STRIP_STATE_STRING_LITERAL_ESCAPE:
+		return strip_dfa_literal_transition( c, STRIP_CLASS_DOUBLE_QUOTE, STRIP_STATE_STRING_LITERAL, STRIP_STATE_STRING_LITERAL_ESCAPE, true );
+
+	case STRIP_STATE_CHAR_LITERAL:
+		return strip_dfa_literal_transition( c, STRIP_CLASS_SINGLE_QUOTE, STRIP_STATE_CHAR_LITERAL, STRIP_STATE_CHAR_LITERAL_ESCAPE, false );
+
+	case STRIP_STATE_CHAR_LITERAL_ESCAPE:
+		return strip_dfa_literal_transition( c, STRIP_CLASS_SINGLE_QUOTE, STRIP_STATE_CHAR_LITERAL, STRIP_STATE_CHAR_LITERAL_ESCAPE, true );
+
+	default:
+		return strip_dfa_transition( STRIP_STATE_END, false, false );
+	}
+}
+
+constexpr StripDFA strip_dfa_build()
+{
+	StripDFA dfa = {};
+
+	for ( u32 c = 0; c < 256; ++c )
+	{
+		switch ( c )
+		{
+		case '/':	dfa.classes[ c ] = STRIP_CLASS_SLASH;			break;
+		case '*':	dfa.classes[ c ] = STRIP_CLASS_STAR;			break;
+		case '"':	dfa.classes[ c ] = STRIP_CLASS_DOUBLE_QUOTE;	break;
+		case '\'':	dfa.classes[ c ] = STRIP_CLASS_SINGLE_QUOTE;	break;
+		case '\\':	dfa.classes[ c ] = STRIP_CLASS_BACKSLASH;		break;
+		case '\n':	dfa.classes[ c ] = STRIP_CLASS_NEWLINE;			break;
+		case '\0':	dfa.classes[ c ] = STRIP_CLASS_TERMINATOR;		break;
+		default:	dfa.classes[ c ] = STRIP_CLASS_OTHER;			break;
+		}
+	}
+
+	for ( StripState s = 0; s < STRIP_STATE_COUNT; ++s )
+	{
+		for ( StripClass c = 0; c < STRIP_CLASS_COUNT; ++c )
+		{
+			dfa.transitions[ s ][ c ] = strip_dfa_build_transition( s, c );
+		}
+	}
+
+	return dfa;
+}
+
+constexpr const StripDFA STRIP_DFA = strip_dfa_build();
+
+u64 strip_comments_dfa( const u8 *src, u64 size, u8 *dst )
+{
+	u8 *dstStart = dst;
+	StripState state = STRIP_STATE_CODE;
+
+	// Includes the null terminator, so a pending '/' gets flushed
+	for ( u64 i = 0; i <= size && state != STRIP_STATE_END; ++i )
+	{
+		u8 c = src[ i ];
+		u8 t = STRIP_DFA.transitions[ state ][ STRIP_DFA.classes[ c ] ];
+		u64 emitSlash = ( t >> STRIP_TRANSITION_EMIT_SLASH_SHIFT ) & 1;
+		u64 emitByte = ( t >> STRIP_TRANSITION_EMIT_BYTE_SHIFT ) & 1;
+
+		// Both are stored every time, the pointer only moves past what is emitted
+		dst[ 0 ] = '/';
+		dst[ emitSlash ] = c;
+		dst += emitSlash + emitByte;
+
+		state = t & STRIP_TRANSITION_STATE_MASK;
+	}
+
+	return dst - dstStart;
+}
+
+// SKIP //////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// memchr style searches, 8 bytes at a time. A byte matches if it is equal to any of the targets,
+// the lowest flagged byte is always a real match (false positives can only appear above one).
+
+constexpr const u64 STRIP_SWAR_ONES = 0x0101010101010101ull;
+constexpr const u64 STRIP_SWAR_HIGHS = 0x8080808080808080ull;
+
+static inline u64 strip_swar_match( u64 word, u8 target )
+{
+	u64 x = word ^ ( STRIP_SWAR_ONES * target );
+	return ( x - STRIP_SWAR_ONES ) & ~x & STRIP_SWAR_HIGHS;
+}
+
+static inline u64 strip_count_trailing_zeros( u64 value )
+{
+	#if defined( _MSC_VER )
+		unsigned long index;
+		_BitScanForward64( &index, value );
+		return index;
+	#else
+		return __builtin_ctzll( value );
+	#endif
+}
+
+template <u8... Targets>
+[[nodiscard]] static inline const u8 *strip_find_first( const u8 *src, const u8 *end )
+{
+	while ( src + sizeof( u64 ) <= end )
+	{
+		u64 word;
+		memcpy( &word, src, sizeof( u64 ) );
+
+		u64 match = ( strip_swar_match( word, Targets ) | ... );
+		if ( match )
+			return src + ( strip_count_trailing_zeros( match ) >> 3 );
+
+		src += sizeof( u64 );
+	}
+
+	while ( src < end && ( ( *src != Targets ) && ... ) )
+		src += 1;
+
+	return src;
+}
+
+[[nodiscard]] const u8 *strip_skip_code( const u8 *src, const u8 *end )
+{
+	return strip_find_first<'/', '"', '\'', '\n', '\0'>( src, end );
+}
+
+[[nodiscard]] const u8 *strip_skip_line_comment( const u8 *src, const u8 *end )
+{
+	return strip_find_first<'\n', '\0'>( src, end );
+}
+
+[[nodiscard]] const u8 *strip_skip_block_comment( const u8 *src, const u8 *end )
+{
+	// Only a '*' followed by '/' matters, a '*' on the last byte is returned so the caller can hold it
+	while ( ( src = strip_find_first<'*', '\0'>( src, end ) ) < end && *src != '\0' && src + 1 < end && src[ 1 ] != '/' )
+		src += 1;
+
+	return src;
+}
+
+[[nodiscard]] const u8 *strip_skip_string_literal( const u8 *src, const u8 *end )
+{
+	return strip_find_first<'"', '\n', '\0'>( src, end );
+}
+
+[[nodiscard]] const u8 *strip_skip_char_literal( const u8 *src, const u8 *end )
+{
+	return strip_find_first<'\'', '\n', '\0'>( src, end );
+}
+
+// Emitters for the skip engine, either compacting into a buffer or recording spans of the source
+struct StripBufferEmitter
+{
+	u8 *dst;
+
+	inline void emit( const u8 *src, u64 size )
+	{
+		memmove( dst, src, size );
+		dst += size;
+	}
+};
+
+struct StripSpanEmitter
+{
+	StripSpanBatch *batch;
+	bool failed;
+
+	inline void emit( const u8 *src, u64 size )
+	{
+		if ( size == 0 || failed )
+			return;
+
+		batch->bytes += size;
+
+		// Runs that continue the last span just extend it
+		if ( batch->count > 0 )
+		{
+			FileSpan *last = &batch->spans[ batch->count - 1 ];
+			if ( static_cast<const u8 *>( last->data ) + last->size == src )
+			{
+				last->size += size;
+				return;
+			}
+		}
+
+		if ( batch->count == batch->capacity )
+		{
+			failed = !batch->flush_func( batch );
+			batch->count = 0;
+		}
+
+		batch->spans[ batch->count++ ] = { .data = src, .size = size };
+	}
+};
+
+// Resumable, [size] bytes are processed with no terminator needed after them. The state carries
+// what the previous chunk left unfinished, a held '/' or '*' and whether its last byte was a backslash
+template <typename Emitter>
+static void strip_comments_skip_internal( const u8 *src, u64 size, StripState *pState, Emitter *emitter )
+{
+	static const u8 pendingSlash = '/';
+
+	const u8 *srcStart = src;
+	const u8 *end = src + size;
+	StripState state = *pState;
+	bool escapedStart = false;
+
+	if ( size == 0 || state == STRIP_STATE_END )
+		return;
+
+	switch ( state )
+	{
+	case STRIP_STATE_CODE_ESCAPE:			state = STRIP_STATE_CODE;			escapedStart = true;	break;
+	case STRIP_STATE_STRING_LITERAL_ESCAPE:	state = STRIP_STATE_STRING_LITERAL;	escapedStart = true;	break;
+	case STRIP_STATE_CHAR_LITERAL_ESCAPE:	state = STRIP_STATE_CHAR_LITERAL;	escapedStart = true;	break;
+
+	case STRIP_STATE_CODE_SLASH:
+		if ( *src == '/' || *src == '*' )
+		{
+			state = ( *src == '/' ? STRIP_STATE_LINE_COMMENT : STRIP_STATE_BLOCK_COMMENT );
+			src += 1;
+		}
+		else
+		{
+			emitter->emit( &pendingSlash, 1 );
+			state = STRIP_STATE_CODE;
+		}
+		break;
+
+	case STRIP_STATE_BLOCK_COMMENT_STAR:
+		if ( *src == '/' )
+		{
+			state = STRIP_STATE_CODE;
+			src += 1;
+		}
+		else
+		{
+			state = STRIP_STATE_BLOCK_COMMENT;
+		}
+		break;
+	}
+
+	while ( true )
+	{
+		const u8 *next;
+
+		switch ( state )
+		{
+		case STRIP_STATE_CODE:				next = strip_skip_code( src, end );				break;
+		case STRIP_STATE_LINE_COMMENT:		next = strip_skip_line_comment( src, end );		break;
+		case STRIP_STATE_BLOCK_COMMENT:		next = strip_skip_block_comment( src, end );	break;
+		case STRIP_STATE_STRING_LITERAL:	next = strip_skip_string_literal( src, end );	break;
+		default:							next = strip_skip_char_literal( src, end );		break;
+		}
+
+		// Comments are skipped, everything else is kept
+		if ( state != STRIP_STATE_LINE_COMMENT && state != STRIP_STATE_BLOCK_COMMENT )
+		{
+			emitter->emit( src, next - src );
+		}
+
+		if ( next == end )
+			break;
+
+		u8 c = *next;
+
+		if ( c == '\0' )
+		{
+			state = STRIP_STATE_END;
+			break;
+		}
+
+		bool escaped = ( next > srcStart ? next[ -1 ] == '\\' : escapedStart );
+		src = next + 1;
+
+		// A '/' or '*' on the last byte can't be decided yet, it is held in the state
+		if ( src == end && ( ( state == STRIP_STATE_CODE && c == '/' ) || state == STRIP_STATE_BLOCK_COMMENT ) )
+		{
+			state = ( state == STRIP_STATE_CODE ? STRIP_STATE_CODE_SLASH : STRIP_STATE_BLOCK_COMMENT_STAR );
+			break;
+		}
+
+		switch ( state )
+		{
+		case STRIP_STATE_CODE:
+			if ( c == '/' )
+			{
+				if ( *src == '/' || *src == '*' )
+				{
+					state = ( *src == '/' ? STRIP_STATE_LINE_COMMENT : STRIP_STATE_BLOCK_COMMENT );
+					src += 1;
+				}
+				else
+				{
+					emitter->emit( next, 1 );
+				}
+			}
+			else if ( c != '\n' )
+			{
+				emitter->emit( next, 1 );
+				if ( !escaped )
+					state = ( c == '"' ? STRIP_STATE_STRING_LITERAL : STRIP_STATE_CHAR_LITERAL );
+			}
+			break;
+
+		case STRIP_STATE_LINE_COMMENT:
+			state = STRIP_STATE_CODE;
+			break;
+
+		case STRIP_STATE_BLOCK_COMMENT:
+			state = STRIP_STATE_CODE;
+			src += 1;
+			break;
+
+		default:
+			if ( c != '\n' )
+			{
+				emitter->emit( next, 1 );
+				if ( !escaped )
+					state = STRIP_STATE_CODE;
+			}
+			break;
+		}
+	}
+
+	// The next chunk needs to know if its first quote is escaped
+	if ( end[ -1 ] == '\\' )
+	{
+		switch ( state )
+		{
+		case STRIP_STATE_CODE:				state = STRIP_STATE_CODE_ESCAPE;			break;
+		case STRIP_STATE_STRING_LITERAL:	state = STRIP_STATE_STRING_LITERAL_ESCAPE;	break;
+		case STRIP_STATE_CHAR_LITERAL:		state = STRIP_STATE_CHAR_LITERAL_ESCAPE;	break;
+		}
+	}
+
+	*pState = state;
+}
+
+u64 strip_comments_skip( const u8 *src, u64 size, u8 *dst )
+{
+	StripState state = STRIP_STATE_CODE;
+	StripBufferEmitter emitter = { .dst = dst };
+	strip_comments_skip_internal( src, size, &state, &emitter );
+	return ( emitter.dst - dst ) + strip_comments_chunk_end( state, emitter.dst );
+}
+
+u64 strip_comments_chunk( const u8 *src, u64 size, u8 *dst, StripState *state )
+{
+	StripBufferEmitter emitter = { .dst = dst };
+	strip_comments_skip_internal( src, size, state, &emitter );
+	return emitter.dst - dst;
+}
+
+u64 strip_comments_chunk_end( StripState state, u8 *dst )
+{
+	// Only a held '/' is still owed, a held '*' was inside a comment
+	if ( state != STRIP_STATE_CODE_SLASH )
+		return 0;
+
+	dst[ 0 ] = '/';
+	return 1;
+}
+
+bool strip_comments_spans( const u8 *src, u64 size, StripSpanBatch *batch )
+{
+	StripState state = STRIP_STATE_CODE;
+	StripSpanEmitter emitter = { .batch = batch, .failed = false };
+	strip_comments_skip_internal( src, size, &state, &emitter );
+
+	if ( state == STRIP_STATE_CODE_SLASH )
+		emitter.emit( src + size - 1, 1 );
+
+	if ( !emitter.failed && batch->count > 0 )
+		emitter.failed = !batch->flush_func( batch );
+
+	batch->count = 0;
+
+	return !emitter.failed;
+}
+
+// PARALLEL //////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Used when only the exit state is wanted
+struct StripNullEmitter
+{
+	inline void emit( const u8 *src, u64 size )
+	{
+		(void)src;
+		(void)size;
+	}
+};
+
+struct StripParallelChunk
+{
+	const u8 *src;
+	u64 size;
+	u8 *dst;
+	u64 written;
+	u8 next;									// first byte of the next chunk, or the terminator
+	StripState entry;
+	StripState exits[ STRIP_STATE_COUNT ];		// where the chunk ends up from each entry state
+};
+
+static void strip_parallel_speculate( u64 task, u32 worker, void *user )
+{
+	(void)worker;
+
+	StripParallelChunk *chunk = &static_cast<StripParallelChunk *>( user )[ task ];
+	u64 prefix = min( chunk->size, STRIP_SPECULATE_PREFIX );
+
+	// Stepped together through the first bytes, most entry states fall into the same one within a few
+	// lines. Strings don't end at a newline, so inside and outside a string usually stay apart
+	for ( StripState s = 0; s < STRIP_STATE_COUNT; ++s )
+		chunk->exits[ s ] = s;
+
+	u64 i = 0;
+
+	while ( i < prefix )
+	{
+		for ( u64 stepEnd = min( i + 64, prefix ); i < stepEnd; ++i )
+		{
+			StripClass c = STRIP_DFA.classes[ chunk->src[ i ] ];
+
+			for ( StripState s = 0; s < STRIP_STATE_COUNT; ++s )
+				chunk->exits[ s ] = STRIP_DFA.transitions[ chunk->exits[ s ] ][ c ] & STRIP_TRANSITION_STATE_MASK;
+		}
+
+		u32 distinct = 0;
+		u32 seen = 0;
+
+		for ( StripState s = 0; s < STRIP_STATE_COUNT; ++s )
+		{
+			distinct += ( ( seen >> chunk->exits[ s ] ) & 1 ) ^ 1;
+			seen |= BIT( chunk->exits[ s ] );
+		}
+
+		if ( distinct <= 2 )
+			break;
+	}
+
+	// Only the distinct survivors are run over the rest of the chunk
+	bool done[ STRIP_STATE_COUNT ] = {};
+
+	for ( StripState s = 0; s < STRIP_STATE_COUNT; ++s )
+	{
+		if ( done[ s ] )
+			continue;
+
+		StripState from = chunk->exits[ s ];
+		StripState to = from;
+		StripNullEmitter emitter;
+		strip_comments_skip_internal( chunk->src + i, chunk->size - i, &to, &emitter );
+
+		for ( StripState t = s; t < STRIP_STATE_COUNT; ++t )
+		{
+			if ( !done[ t ] && chunk->exits[ t ] == from )
+			{
+				chunk->exits[ t ] = to;
+				done[ t ] = true;
+			}
+		}
+	}
+}
+
+static void strip_parallel_strip( u64 task, u32 worker, void *user )
+{
+	(void)worker;
+
+	StripParallelChunk *chunk = &static_cast<StripParallelChunk *>( user )[ task ];
+	const u8 *src = chunk->src;
+	u64 size = chunk->size;
+	StripState state = chunk->entry;
+
+	// A held '/' belongs to the chunk before, this one only needs to know if it opened a comment
+	if ( state == STRIP_STATE_CODE_SLASH )
+	{
+		if ( size > 0 && ( *src == '/' || *src == '*' ) )
+		{
+			state = ( *src == '/' ? STRIP_STATE_LINE_COMMENT : STRIP_STATE_BLOCK_COMMENT );
+			src += 1;
+			size -= 1;
+		}
+		else
+		{
+			state = STRIP_STATE_CODE;
+		}
+	}
+
+	// Compacted within the chunk's own part of dst, so the chunks never overlap
+	StripBufferEmitter emitter = { .dst = chunk->dst };
+	strip_comments_skip_internal( src, size, &state, &emitter );
+
+	// The held '/' wasn't emitted, so there is always room for it if it turns out not to be a comment
+	if ( state == STRIP_STATE_CODE_SLASH && chunk->next != '/' && chunk->next != '*' )
+		*emitter.dst++ = '/';
+
+	chunk->written = emitter.dst - chunk->dst;
+}
+
+u64 strip_comments_parallel( const u8 *src, u64 size, u8 *dst, u32 chunkCount, ThreadPool *pool, Allocator *allocator )
+{
+	if ( chunkCount > THREAD_MAX_WORKERS )
+		chunkCount = THREAD_MAX_WORKERS;
+
+	if ( chunkCount > size )
+		chunkCount = static_cast<u32>( size );
+
+	if ( chunkCount <= 1 )
+		return strip_comments_skip( src, size, dst );
+
+	StripParallelChunk *chunks = allocator->allocate<StripParallelChunk>( chunkCount );
+
+	if ( !chunks )
+		return strip_comments_skip( src, size, dst );
+
+	for ( u32 i = 0; i < chunkCount; ++i )
+	{
+		u64 begin = size * i / chunkCount;
+		u64 end = size * ( i + 1 ) / chunkCount;
+
+		chunks[ i ].src = src + begin;
+		chunks[ i ].size = end - begin;
+		chunks[ i ].dst = dst + begin;
+		chunks[ i ].written = 0;
+		chunks[ i ].next = src[ end ];
+	}
+
+	thread_pool_run( pool, chunkCount, chunkCount, strip_parallel_speculate, chunks );
+
+	// The only sequential part, one lookup per chunk
+	StripState state = STRIP_STATE_CODE;
+
+	for ( u32 i = 0; i < chunkCount; ++i )
+	{
+		chunks[ i ].entry = state;
+		state = chunks[ i ].exits[ state ];
+	}
+
+	thread_pool_run( pool, chunkCount, chunkCount, strip_parallel_strip, chunks );
+
+	u8 *out = dst;
+
+	for ( u32 i = 0; i < chunkCount; ++i )
+	{
+		memmove( out, chunks[ i ].dst, chunks[ i ].written );
+		out += chunks[ i ].written;
+	}
+
+	allocator->free( chunks );
+
+	return out - dst;
+}
+
+#endif
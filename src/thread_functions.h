@@ -0,0 +1,449 @@
+
+#ifndef _HG_THREAD_FUNCTIONS
+#define _HG_THREAD_FUNCTIONS
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+
+constexpr const u32 THREAD_MAX_WORKERS = 64;
+
+using ThreadTaskFunc = void ( * )( u64 task, u32 worker, void *user );
+
+// Each worker owns a range of task indices and takes from the front of it. A worker that runs
+// out steals the back half of another worker's range, so a few big files don't leave cores idle
+struct alignas( 64 ) ThreadWorker
+{
+	std::atomic<u64> range;				// begin in the low 32 bits, end in the high 32 bits
+	struct ThreadPool *pool;
+	u64 thread;
+	u32 index;
+};
+
+struct ThreadPool
+{
+	ThreadWorker workers[ THREAD_MAX_WORKERS ];
+	u32 workerCount;
+	ThreadTaskFunc func;
+	void *user;
+
+	// Only for a started pool, its threads wait on the generation between runs
+	u32 threadCount;						// counting the caller, 0 unless started
+	bool stopping;
+	std::atomic<u32> generation;
+	std::atomic<u32> running;				// started threads still in the current run
+};
+
+// Runs func for every task in [ 0, taskCount ) on up to workerCount threads and returns once
+// they are all done. Worker 0 is the calling thread, the rest are started and joined here,
+// or woken up if the pool was started, and then never more than it was started with
+void thread_pool_run( ThreadPool *pool, u32 workerCount, u64 taskCount, ThreadTaskFunc func, void *user );
+
+// Keeps threadCount - 1 threads waiting for runs, for a pool that runs many short ones. Only one
+// thread may run it at a time. If they can't all be started none are, and runs start their own
+bool thread_pool_start( ThreadPool *pool, u32 threadCount );
+void thread_pool_stop( ThreadPool *pool );
+
+// For work that is found while it runs, like walking a directory tree. Tasks are intrusive nodes
+// pushed by the caller up front or by running tasks, and owned by the task function once popped
+struct ThreadQueueNode
+{
+	ThreadQueueNode *next;
+};
+
+using ThreadQueueFunc = void ( * )( ThreadQueueNode *node, u32 worker, void *user );
+
+struct ThreadQueueWorker
+{
+	struct ThreadQueue *queue;
+	u64 thread;
+	u32 index;
+};
+
+struct ThreadQueue
+{
+	std::mutex mutex;
+	std::condition_variable wake;
+	ThreadQueueNode *head = nullptr;		// newest first, so a tree walk stays depth first
+	u64 pending = 0;						// queued plus running, nothing more can arrive once it is 0
+	ThreadQueueFunc func = nullptr;
+	void *user = nullptr;
+	ThreadQueueWorker workers[ THREAD_MAX_WORKERS ];
+};
+
+void thread_queue_push( ThreadQueue *queue, ThreadQueueNode *node );
+
+// Returns once the queue is empty and no task is left running. Worker 0 is the calling thread
+void thread_queue_run( ThreadQueue *queue, u32 workerCount, ThreadQueueFunc func, void *user );
+
+constexpr const u32 THREAD_RING_SIZE = 64;
+
+// Bounded queue between exactly one producing thread and one consuming thread, for passing work
+// from one stage of a pipeline to the next. Push waits while it is full and pop while it is empty
+struct ThreadRing
+{
+	alignas( 64 ) std::atomic<u32> head = 0;		// only the consumer moves it
+	alignas( 64 ) std::atomic<u32> tail = 0;		// only the producer moves it
+	alignas( 64 ) u64 items[ THREAD_RING_SIZE ];
+};
+
+void thread_ring_push( ThreadRing *ring, u64 item );
+[[nodiscard]] u64 thread_ring_pop( ThreadRing *ring );
+
+#endif // _HG_THREAD_FUNCTIONS
+
+// --------------------------------------------------------------------------------
+
+#if defined( THREAD_FUNCTIONS_IMPLEMENTATION )
+
+static inline u64 thread_range_pack( u32 begin, u32 end )
+{
+	return ( static_cast<u64>( end ) << 32 ) | begin;
+}
+
+static bool thread_worker_pop( ThreadWorker *worker, u64 *task )
+{
+	u64 range = worker->range.load( std::memory_order_acquire );
+
+	while ( true )
+	{
+		u32 begin = static_cast<u32>( range );
+		u32 end = static_cast<u32>( range >> 32 );
+
+		if ( begin >= end )
+			return false;
+
+		if ( worker->range.compare_exchange_weak( range, thread_range_pack( begin + 1, end ), std::memory_order_acq_rel, std::memory_order_acquire ) )
+		{
+			*task = begin;
+			return true;
+		}
+	}
+}
+
+// Only called once the worker's own range is empty, so nobody else will touch it until it is
+// refilled. A thief that loses the race just finds it empty and moves on to the next victim
+static bool thread_worker_steal( ThreadWorker *worker )
+{
+	ThreadPool *pool = worker->pool;
+
+	for ( u32 i = 1; i < pool->workerCount; ++i )
+	{
+		ThreadWorker *victim = &pool->workers[ ( worker->index + i ) % pool->workerCount ];
+		u64 range = victim->range.load( std::memory_order_acquire );
+
+		while ( true )
+		{
+			u32 begin = static_cast<u32>( range );
+			u32 end = static_cast<u32>( range >> 32 );
+
+			if ( begin >= end )
+				break;
+
+			u32 split = end - ( end - begin + 1 ) / 2;
+
+			if ( victim->range.compare_exchange_weak( range, thread_range_pack( begin, split ), std::memory_order_acq_rel, std::memory_order_acquire ) )
+			{
+				worker->range.store( thread_range_pack( split, end ), std::memory_order_release );
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+static void thread_worker_run( void *user )
+{
+	ThreadWorker *worker = static_cast<ThreadWorker *>( user );
+	ThreadPool *pool = worker->pool;
+
+	do
+	{
+		u64 task;
+		while ( thread_worker_pop( worker, &task ) )
+			pool->func( task, worker->index, pool->user );
+	} while ( thread_worker_steal( worker ) );
+}
+
+// A started pool's threads, they leave once it is stopping
+static void thread_pool_thread_run( void *user )
+{
+	ThreadWorker *worker = static_cast<ThreadWorker *>( user );
+	ThreadPool *pool = worker->pool;
+	u32 generation = 0;
+
+	while ( true )
+	{
+		pool->generation.wait( generation, std::memory_order_acquire );
+		generation = pool->generation.load( std::memory_order_acquire );
+
+		if ( pool->stopping )
+			break;
+
+		// A run with fewer tasks than threads leaves the rest with nothing, not even to steal
+		if ( worker->index < pool->workerCount )
+			thread_worker_run( worker );
+
+		if ( pool->running.fetch_sub( 1, std::memory_order_acq_rel ) == 1 )
+			pool->running.notify_one();
+	}
+}
+
+bool thread_pool_start( ThreadPool *pool, u32 threadCount )
+{
+	if ( threadCount > THREAD_MAX_WORKERS )
+		threadCount = THREAD_MAX_WORKERS;
+
+	pool->threadCount = 0;
+	pool->workerCount = 0;
+	pool->stopping = false;
+	pool->generation.store( 0, std::memory_order_relaxed );
+	pool->running.store( 0, std::memory_order_relaxed );
+
+	for ( u32 i = 0; i < threadCount; ++i )
+	{
+		ThreadWorker *worker = &pool->workers[ i ];
+		worker->range.store( 0, std::memory_order_relaxed );
+		worker->pool = pool;
+		worker->thread = 0;
+		worker->index = i;
+	}
+
+	for ( u32 i = 1; i < threadCount; ++i )
+	{
+		ThreadWorker *worker = &pool->workers[ i ];
+		worker->thread = platform_thread_create( thread_pool_thread_run, worker );
+
+		if ( !worker->thread )
+		{
+			log_warning( "Failed to start worker thread %u", i );
+
+			pool->threadCount = i;
+			thread_pool_stop( pool );
+			return false;
+		}
+	}
+
+	pool->threadCount = threadCount;
+
+	return true;
+}
+
+void thread_pool_stop( ThreadPool *pool )
+{
+	if ( pool->threadCount == 0 )
+		return;
+
+	pool->stopping = true;
+	pool->generation.fetch_add( 1, std::memory_order_release );
+	pool->generation.notify_all();
+
+	for ( u32 i = 1; i < pool->threadCount; ++i )
+		platform_thread_join( pool->workers[ i ].thread );
+
+	pool->threadCount = 0;
+}
+
+void thread_pool_run( ThreadPool *pool, u32 workerCount, u64 taskCount, ThreadTaskFunc func, void *user )
+{
+	assert( taskCount <= UINT32_MAX );
+
+	if ( workerCount > THREAD_MAX_WORKERS )
+		workerCount = THREAD_MAX_WORKERS;
+
+	if ( pool->threadCount > 0 && workerCount > pool->threadCount )
+		workerCount = pool->threadCount;
+
+	if ( workerCount > taskCount )
+		workerCount = static_cast<u32>( taskCount );
+
+	if ( workerCount == 0 )
+		workerCount = 1;
+
+	pool->workerCount = workerCount;
+	pool->func = func;
+	pool->user = user;
+
+	// Split the tasks evenly up front, stealing only has to fix up the imbalance
+	for ( u32 i = 0; i < workerCount; ++i )
+	{
+		ThreadWorker *worker = &pool->workers[ i ];
+		u32 begin = static_cast<u32>( taskCount * i / workerCount );
+		u32 end = static_cast<u32>( taskCount * ( i + 1 ) / workerCount );
+
+		worker->range.store( thread_range_pack( begin, end ), std::memory_order_relaxed );
+
+		// A started pool's threads already have theirs, and read them before waiting
+		if ( pool->threadCount == 0 )
+		{
+			worker->pool = pool;
+			worker->index = i;
+		}
+	}
+
+	// Everything above is published by the generation, every thread wakes and counts itself out
+	if ( pool->threadCount > 0 )
+	{
+		pool->running.store( pool->threadCount - 1, std::memory_order_relaxed );
+		pool->generation.fetch_add( 1, std::memory_order_release );
+		pool->generation.notify_all();
+
+		thread_worker_run( &pool->workers[ 0 ] );
+
+		u32 running = pool->running.load( std::memory_order_acquire );
+
+		while ( running != 0 )
+		{
+			pool->running.wait( running, std::memory_order_acquire );
+			running = pool->running.load( std::memory_order_acquire );
+		}
+
+		return;
+	}
+
+	// A worker that fails to start still has its range stolen by the others
+	for ( u32 i = 1; i < workerCount; ++i )
+	{
+		ThreadWorker *worker = &pool->workers[ i ];
+		worker->thread = platform_thread_create( thread_worker_run, worker );
+
+		if ( !worker->thread )
+			log_warning( "Failed to start worker thread %u", i );
+	}
+
+	thread_worker_run( &pool->workers[ 0 ] );
+
+	for ( u32 i = 1; i < workerCount; ++i )
+		platform_thread_join( pool->workers[ i ].thread );
+}
+
+void thread_queue_push( ThreadQueue *queue, ThreadQueueNode *node )
+{
+	{
+		std::lock_guard<std::mutex> lock( queue->mutex );
+		node->next = queue->head;
+		queue->head = node;
+		queue->pending += 1;
+	}
+
+	queue->wake.notify_one();
+}
+
+static void thread_queue_worker_run( void *user )
+{
+	ThreadQueueWorker *worker = static_cast<ThreadQueueWorker *>( user );
+	ThreadQueue *queue = worker->queue;
+	std::unique_lock<std::mutex> lock( queue->mutex );
+
+	while ( true )
+	{
+		if ( !queue->head && queue->pending > 0 )
+		{
+			trace_begin( "idle" );
+
+			while ( !queue->head && queue->pending > 0 )
+				queue->wake.wait( lock );
+
+			trace_end( "idle" );
+		}
+
+		if ( !queue->head )
+			break;
+
+		ThreadQueueNode *node = queue->head;
+		queue->head = node->next;
+
+		lock.unlock();
+		queue->func( node, worker->index, queue->user );
+		lock.lock();
+
+		// The last task out wakes everyone so they can leave
+		if ( --queue->pending == 0 )
+			queue->wake.notify_all();
+	}
+}
+
+void thread_queue_run( ThreadQueue *queue, u32 workerCount, ThreadQueueFunc func, void *user )
+{
+	if ( workerCount > THREAD_MAX_WORKERS )
+		workerCount = THREAD_MAX_WORKERS;
+
+	if ( workerCount == 0 )
+		workerCount = 1;
+
+	queue->func = func;
+	queue->user = user;
+
+	for ( u32 i = 0; i < workerCount; ++i )
+	{
+		ThreadQueueWorker *worker = &queue->workers[ i ];
+		worker->queue = queue;
+		worker->thread = 0;
+		worker->index = i;
+	}
+
+	for ( u32 i = 1; i < workerCount; ++i )
+	{
+		ThreadQueueWorker *worker = &queue->workers[ i ];
+		worker->thread = platform_thread_create( thread_queue_worker_run, worker );
+
+		if ( !worker->thread )
+			log_warning( "Failed to start worker thread %u", i );
+	}
+
+	thread_queue_worker_run( &queue->workers[ 0 ] );
+
+	for ( u32 i = 1; i < workerCount; ++i )
+		platform_thread_join( queue->workers[ i ].thread );
+}
+
+void thread_ring_push( ThreadRing *ring, u64 item )
+{
+	u32 tail = ring->tail.load( std::memory_order_relaxed );
+	u32 head = ring->head.load( std::memory_order_acquire );
+
+	if ( tail - head == THREAD_RING_SIZE )
+	{
+		trace_begin( "wait full" );
+
+		while ( tail - head == THREAD_RING_SIZE )
+		{
+			ring->head.wait( head, std::memory_order_acquire );
+			head = ring->head.load( std::memory_order_acquire );
+		}
+
+		trace_end( "wait full" );
+	}
+
+	ring->items[ tail % THREAD_RING_SIZE ] = item;
+	ring->tail.store( tail + 1, std::memory_order_release );
+	ring->tail.notify_one();
+}
+
+u64 thread_ring_pop( ThreadRing *ring )
+{
+	u32 head = ring->head.load( std::memory_order_relaxed );
+	u32 tail = ring->tail.load( std::memory_order_acquire );
+
+	if ( head == tail )
+	{
+		trace_begin( "wait empty" );
+
+		while ( head == tail )
+		{
+			ring->tail.wait( tail, std::memory_order_acquire );
+			tail = ring->tail.load( std::memory_order_acquire );
+		}
+
+		trace_end( "wait empty" );
+	}
+
+	u64 item = ring->items[ head % THREAD_RING_SIZE ];
+	ring->head.store( head + 1, std::memory_order_release );
+	ring->head.notify_one();
+
+	return item;
+}
+
+#endif
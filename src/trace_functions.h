@@ -0,0 +1,222 @@
+
+#ifndef _HG_TRACE_FUNCTIONS
+#define _HG_TRACE_FUNCTIONS
+
+#include <atomic>
+
+// Begin and end events for a timeline, written out in Chrome's trace event format so Perfetto or
+// chrome://tracing can open them. Each thread records into its own ring and never waits on another
+
+constexpr const u64 TRACE_RING_SIZE = 1 << 18;		// events kept per thread, older ones are overwritten
+
+struct TraceEvent
+{
+	const char *name;			// a string literal, only the pointer is kept
+	u64 ticks;
+	u8 phase;					// 'B' or 'E'
+};
+
+struct TraceRing
+{
+	TraceRing *next;
+	u32 thread;
+	std::atomic<u64> count;		// every event ever recorded, only the owning thread moves it
+	TraceEvent events[ TRACE_RING_SIZE ];
+};
+
+// Off until trace_enable, and then every thread's first event sets up its ring
+std::atomic<bool> traceEnabled = false;
+
+void trace_enable();
+void trace_record( const char *name, u8 phase );
+
+// Writes every ring out and frees them, once nothing is recording anymore
+bool trace_write( const char *path );
+
+static inline void trace_begin( const char *name )
+{
+	if ( traceEnabled.load( std::memory_order_relaxed ) ) [[unlikely]]
+		trace_record( name, 'B' );
+}
+
+static inline void trace_end( const char *name )
+{
+	if ( traceEnabled.load( std::memory_order_relaxed ) ) [[unlikely]]
+		trace_record( name, 'E' );
+}
+
+#endif // _HG_TRACE_FUNCTIONS
+
+// --------------------------------------------------------------------------------
+
+#if defined( TRACE_FUNCTIONS_IMPLEMENTATION )
+
+// Rings are pushed on the front and only walked once recording has stopped
+static std::atomic<TraceRing *> traceRings = nullptr;
+static std::atomic<u32> traceThreads = 0;
+static thread_local TraceRing *traceRing = nullptr;
+
+void trace_enable()
+{
+	traceEnabled.store( true, std::memory_order_relaxed );
+}
+
+static TraceRing *trace_ring_create()
+{
+	u8 *data = platform_memory_reserve( sizeof( TraceRing ) );
+
+	if ( !data || !platform_memory_commit( data, sizeof( TraceRing ) ) )
+	{
+		if ( data )
+			platform_memory_release( data, sizeof( TraceRing ) );
+
+		log_warning( "Failed to allocate a trace ring" );
+		return nullptr;
+	}
+
+	// Fresh pages are already zero, so only the pages that get written are ever touched
+	TraceRing *ring = reinterpret_cast<TraceRing *>( data );
+	ring->thread = traceThreads.fetch_add( 1, std::memory_order_relaxed );
+
+	TraceRing *head = traceRings.load( std::memory_order_relaxed );
+	do
+	{
+		ring->next = head;
+	} while ( !traceRings.compare_exchange_weak( head, ring, std::memory_order_release, std::memory_order_relaxed ) );
+
+	return ring;
+}
+
+void trace_record( const char *name, u8 phase )
+{
+	u64 ticks = platform_get_tick_counter();
+
+	if ( !traceRing )
+	{
+		traceRing = trace_ring_create();
+
+		if ( !traceRing )
+		{
+			// Without a ring this thread just goes missing from the timeline
+			traceRing = reinterpret_cast<TraceRing *>( -1 );
+		}
+	}
+
+	if ( traceRing == reinterpret_cast<TraceRing *>( -1 ) )
+		return;
+
+	u64 count = traceRing->count.load( std::memory_order_relaxed );
+	TraceEvent *event = &traceRing->events[ count % TRACE_RING_SIZE ];
+	event->name = name;
+	event->ticks = ticks;
+	event->phase = phase;
+
+	traceRing->count.store( count + 1, std::memory_order_release );
+}
+
+struct TraceWriter
+{
+	u64 fileID;
+	u64 used;
+	bool first;
+	bool failed;
+	char buffer[ KB( 64 ) ];
+};
+
+static void trace_flush( TraceWriter *writer )
+{
+	if ( writer->used > 0 && write_to_file( writer->fileID, writer->buffer, writer->used ) != writer->used )
+		writer->failed = true;
+
+	writer->used = 0;
+}
+
+static void trace_put_event( TraceWriter *writer, const TraceEvent *event, u32 thread, f64 ticksPerMicrosecond )
+{
+	// Plenty for one event, names are short literals
+	if ( sizeof( writer->buffer ) - writer->used < 512 )
+		trace_flush( writer );
+
+	f64 microseconds = static_cast<f64>( event->ticks - platform->startCycles ) / ticksPerMicrosecond;
+
+	i32 length = snprintf( writer->buffer + writer->used, sizeof( writer->buffer ) - writer->used, "%s{\"name\":\"%.256s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":%u}",
+		writer->first ? "\n" : ",\n", event->name, static_cast<char>( event->phase ), microseconds, thread );
+
+	writer->used += static_cast<u64>( max( length, 0 ) );
+	writer->first = false;
+}
+
+static void trace_put_ring( TraceWriter *writer, const TraceRing *ring, f64 ticksPerMicrosecond )
+{
+	u64 count = ring->count.load( std::memory_order_acquire );
+	u64 first = ( count > TRACE_RING_SIZE ? count - TRACE_RING_SIZE : 0 );
+
+	// A ring that wrapped lost the begin of some of its first ends, those are left out so the
+	// viewer doesn't pair them with the wrong begin
+	u64 depth = 0;
+
+	for ( u64 i = first; i < count; ++i )
+	{
+		const TraceEvent *event = &ring->events[ i % TRACE_RING_SIZE ];
+
+		if ( event->phase == 'B' )
+			depth += 1;
+		else if ( depth > 0 )
+			depth -= 1;
+		else
+			continue;
+
+		trace_put_event( writer, event, ring->thread, ticksPerMicrosecond );
+	}
+}
+
+bool trace_write( const char *path )
+{
+	traceEnabled.store( false, std::memory_order_relaxed );
+
+	TraceWriter *writer = static_cast<TraceWriter *>( ::malloc( sizeof( TraceWriter ) ) );
+
+	if ( !writer )
+		return false;
+
+	writer->fileID = open_file( path, FILE_OPTION_WRITE | FILE_OPTION_CREATE | FILE_OPTION_CLEAR );
+	writer->used = 0;
+	writer->first = true;
+	writer->failed = false;
+
+	if ( writer->fileID == INVALID_FILE_INDEX )
+	{
+		log_warning( "Failed to open trace file: \"%s\"", path );
+		::free( writer );
+		return false;
+	}
+
+	f64 ticksPerMicrosecond = static_cast<f64>( platform_get_tick_frequency() ) / 1000000.0;
+	writer->used += static_cast<u64>( snprintf( writer->buffer, sizeof( writer->buffer ), "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[" ) );
+
+	TraceRing *ring = traceRings.exchange( nullptr, std::memory_order_acquire );
+	traceRing = nullptr;
+
+	while ( ring )
+	{
+		TraceRing *next = ring->next;
+
+		trace_put_ring( writer, ring, ticksPerMicrosecond );
+		platform_memory_release( reinterpret_cast<u8 *>( ring ), sizeof( TraceRing ) );
+
+		ring = next;
+	}
+
+	trace_flush( writer );
+	writer->used += static_cast<u64>( snprintf( writer->buffer, sizeof( writer->buffer ), "\n]}\n" ) );
+	trace_flush( writer );
+
+	close_file( writer->fileID );
+
+	bool result = !writer->failed;
+	::free( writer );
+
+	return result;
+}
+
+#endif
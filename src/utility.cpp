@@ -883,7 +883,7 @@ u64 convert_to_hex_string( char *dest, u64 destSize, vec4 colour, bool uppercase
 
 [[nodiscard]] const char *convert_to_string( u8 value, i32 radix, i32 trailing )
 {
-	Allocator *allocator = &platform->memory.transient;
+	Allocator *allocator = &memory->transient;
 	char *text = allocator->allocate<char>( MAX_CONVERT_TO_STRING_DIGITS );
 	convert_to_string( text, MAX_CONVERT_TO_STRING_DIGITS, value, radix, trailing );
 	allocator->shrink( text, string_utf8_bytes( text ) );
@@ -892,7 +892,7 @@ u64 convert_to_hex_string( char *dest, u64 destSize, vec4 colour, bool uppercase
 
 [[nodiscard]] const char *convert_to_string( u16 value, i32 radix, i32 trailing )
 {
-	Allocator *allocator = &platform->memory.transient;
+	Allocator *allocator = &memory->transient;
 	char *text = allocator->allocate<char>( MAX_CONVERT_TO_STRING_DIGITS );
 	convert_to_string( text, MAX_CONVERT_TO_STRING_DIGITS, value, radix, trailing );
 	allocator->shrink( text, string_utf8_bytes( text ) );
@@ -901,7 +901,7 @@ u64 convert_to_hex_string( char *dest, u64 destSize, vec4 colour, bool uppercase
 
 [[nodiscard]] const char *convert_to_string( u32 value, i32 radix, i32 trailing )
 {
-	Allocator *allocator = &platform->memory.transient;
+	Allocator *allocator = &memory->transient;
 	char *text = allocator->allocate<char>( MAX_CONVERT_TO_STRING_DIGITS );
 	convert_to_string( text, MAX_CONVERT_TO_STRING_DIGITS, value, radix, trailing );
 	allocator->shrink( text, string_utf8_bytes( text ) );
@@ -910,7 +910,7 @@ u64 convert_to_hex_string( char *dest, u64 destSize, vec4 colour, bool uppercase
 
 [[nodiscard]] const char *convert_to_string( u64 value, i32 radix, i32 trailing )
 {
-	Allocator *allocator = &platform->memory.transient;
+	Allocator *allocator = &memory->transient;
 	char *text = allocator->allocate<char>( MAX_CONVERT_TO_STRING_DIGITS );
 	convert_to_string( text, MAX_CONVERT_TO_STRING_DIGITS, value, radix, trailing );
 	allocator->shrink( text, string_utf8_bytes( text ) );
@@ -919,7 +919,7 @@ u64 convert_to_hex_string( char *dest, u64 destSize, vec4 colour, bool uppercase
 
 [[nodiscard]] const char *convert_to_string( i8 value, i32 radix, i32 trailing )
 {
-	Allocator *allocator = &platform->memory.transient;
+	Allocator *allocator = &memory->transient;
 	char *text = allocator->allocate<char>( MAX_CONVERT_TO_STRING_DIGITS );
 	convert_to_string( text, MAX_CONVERT_TO_STRING_DIGITS, value, radix, trailing );
 	allocator->shrink( text, string_utf8_bytes( text ) );
@@ -928,7 +928,7 @@ u64 convert_to_hex_string( char *dest, u64 destSize, vec4 colour, bool uppercase
 
 [[nodiscard]] const char *convert_to_string( i16 value, i32 radix, i32 trailing )
 {
-	Allocator *allocator = &platform->memory.transient;
+	Allocator *allocator = &memory->transient;
 	char *text = allocator->allocate<char>( MAX_CONVERT_TO_STRING_DIGITS );
 	convert_to_string( text, MAX_CONVERT_TO_STRING_DIGITS, value, radix, trailing );
 	allocator->shrink( text, string_utf8_bytes( text ) );
@@ -937,7 +937,7 @@ u64 convert_to_hex_string( char *dest, u64 destSize, vec4 colour, bool uppercase
 
 [[nodiscard]] const char *convert_to_string( i32 value, i32 radix, i32 trailing )
 {
-	Allocator *allocator = &platform->memory.transient;
+	Allocator *allocator = &memory->transient;
 	char *text = allocator->allocate<char>( MAX_CONVERT_TO_STRING_DIGITS );
 	convert_to_string( text, MAX_CONVERT_TO_STRING_DIGITS, value, radix, trailing );
 	allocator->shrink( text, string_utf8_bytes( text ) );
@@ -946,7 +946,7 @@ u64 convert_to_hex_string( char *dest, u64 destSize, vec4 colour, bool uppercase
 
 [[nodiscard]] const char *convert_to_string( i64 value, i32 radix, i32 trailing )
 {
-	Allocator *allocator = &platform->memory.transient;
+	Allocator *allocator = &memory->transient;
 	char *text = allocator->allocate<char>( MAX_CONVERT_TO_STRING_DIGITS );
 	convert_to_string( text, MAX_CONVERT_TO_STRING_DIGITS, value, radix, trailing );
 	allocator->shrink( text, string_utf8_bytes( text ) );
@@ -955,7 +955,7 @@ u64 convert_to_hex_string( char *dest, u64 destSize, vec4 colour, bool uppercase
 
 [[nodiscard]] const char *convert_to_string( f32 value, i32 fracDigits, bool clipZeroFrac )
 {
-	Allocator *allocator = &platform->memory.transient;
+	Allocator *allocator = &memory->transient;
 	char *text = allocator->allocate<char>( MAX_CONVERT_TO_STRING_DIGITS );
 	convert_to_string( text, MAX_CONVERT_TO_STRING_DIGITS, value, fracDigits, clipZeroFrac );
 	allocator->shrink( text, string_utf8_bytes( text ) );
@@ -964,7 +964,7 @@ u64 convert_to_hex_string( char *dest, u64 destSize, vec4 colour, bool uppercase
 
 [[nodiscard]] const char *convert_to_string( bool value )
 {
-	Allocator *allocator = &platform->memory.transient;
+	Allocator *allocator = &memory->transient;
 	char *text = allocator->allocate<char>( MAX_CONVERT_TO_STRING_DIGITS );
 	convert_to_string( text, MAX_CONVERT_TO_STRING_DIGITS, value );
 	allocator->shrink( text, string_utf8_bytes( text ) );
@@ -973,7 +973,7 @@ u64 convert_to_hex_string( char *dest, u64 destSize, vec4 colour, bool uppercase
 
 [[nodiscard]] const char *convert_to_hex_string( vec3 value, bool uppercase )
 {
-	Allocator *allocator = &platform->memory.transient;
+	Allocator *allocator = &memory->transient;
 	char *text = allocator->allocate<char>( MAX_CONVERT_TO_STRING_DIGITS );
 	convert_to_hex_string( text, MAX_CONVERT_TO_STRING_DIGITS, value, uppercase );
 	allocator->shrink( text, string_utf8_bytes( text ) );
@@ -982,7 +982,7 @@ u64 convert_to_hex_string( char *dest, u64 destSize, vec4 colour, bool uppercase
 
 [[nodiscard]] const char *convert_to_hex_string( vec4 value, bool uppercase )
 {
-	Allocator *allocator = &platform->memory.transient;
+	Allocator *allocator = &memory->transient;
 	char *text = allocator->allocate<char>( MAX_CONVERT_TO_STRING_DIGITS );
 	convert_to_hex_string( text, MAX_CONVERT_TO_STRING_DIGITS, value, uppercase );
 	allocator->shrink( text, string_utf8_bytes( text ) );
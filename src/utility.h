@@ -130,10 +130,13 @@ inline void write_data( u8 *&dst, const T *src, u8 *dstBarrier )
 
 [[nodiscard]] i32 value_in_multiples( i32 value, i32 multiple );
 
+// libstdc++ already brings std::lerp( float, float, float ) into the global namespace through math.h
+#if !defined( __GLIBCXX__ ) || __cplusplus <= 201703L
 [[nodiscard]] constexpr inline f32 lerp( f32 a, f32 b, f32 t )
 {
 	return a + t * ( b - a );
 }
+#endif
 
 [[nodiscard]] constexpr inline f32 lerp( i32 a, i32 b, f32 t )
 {